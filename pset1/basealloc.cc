@@ -1,7 +1,6 @@
 #define M61_DISABLE 1
 #include "m61.hh"
-#include <unordered_map>
-#include <vector>
+#include <map>
 #include <sys/mman.h>
 
 
@@ -9,28 +8,108 @@
 // overwrite freed allocations. No need to understand it.
 
 
-using base_allocation = std::pair<uintptr_t, size_t>;
+// Every block gets a `base_block` tag in front of it, outside the memory
+// the caller sees. Sizes are rounded up to classes (powers of two and the
+// 3/4 step between them), and a freed block goes through a FIFO
+// quarantine before it lands on its class's free list, so freed memory
+// stays untouched until plenty of later frees have happened. Reuse is
+// exact fit and O(1).
+//
+// Blocks of small classes are carved in order out of BASE_CHUNK_SIZE
+// chunks, one class per chunk; bigger ones get a chunk each. The chunks
+// are indexed by address, so whether a pointer is one of our blocks is
+// settled by arithmetic before its tag is ever read.
 
-// `allocs` is a hash table mapping active pointer address to allocation size.
-// `frees` is a vector of freed allocations.
-static std::unordered_map<uintptr_t, size_t> allocs;
-static std::vector<base_allocation> frees;
+struct base_block {
+    base_block* next;           // quarantine or free list link
+    uint32_t sclass;
+    uint32_t check;             // base_check(this, live)
+};
+static_assert(sizeof(base_block) == 16, "base blocks stay 16-byte aligned");
+
+#define BASE_NCLASSES 128
+// a freed block is held back until this many blocks or bytes were freed
+// after it
+#define BASE_QUARANTINE_BLOCKS 1024
+#define BASE_QUARANTINE_BYTES ((size_t) 32 << 20)
+#define BASE_CHUNK_SIZE ((size_t) 1 << 20)
+
+struct base_chunk {
+    size_t stride;              // tag plus block size
+    size_t carved;              // bytes handed out so far
+    size_t length;
+};
+
+static base_block* free_lists[BASE_NCLASSES];
+static std::map<uintptr_t, base_chunk> chunks;
+static std::pair<const uintptr_t, base_chunk>* carving[BASE_NCLASSES];
+static base_block* quarantine_head;
+static base_block* quarantine_tail;
+static size_t quarantine_blocks;
+static size_t quarantine_bytes;
 static int disabled;
 
-static unsigned alloc_random() {
-    static uint64_t x = 8973443640547502487ULL;
-    x = x * 6364136223846793005ULL + 1ULL;
-    return x >> 32;
+static uint32_t base_check(const base_block* b, bool live) {
+    uint64_t x = reinterpret_cast<uintptr_t>(b) * 0x9E3779B97F4A7C15ULL;
+    return (x >> 32) ^ (live ? 0xBA5EA110U : 0xF4EEB10CU);
+}
+
+// Return the class of an `sz` byte request.
+static unsigned base_class(size_t sz) {
+    if (sz <= 16) {
+        return 0;
+    }
+    // 2^(b-1) < sz <= 2^b
+    unsigned b = 64 - __builtin_clzll(sz - 1);
+    size_t three_quarters = (size_t) 3 << (b - 2);
+    return 2 * (b - 4) - (sz <= three_quarters ? 1 : 0);
+}
+
+// Return the bytes a block of class `sclass` holds.
+static size_t base_class_size(unsigned sclass) {
+    if (sclass == 0) {
+        return 16;
+    }
+    unsigned b = (sclass + 1) / 2 + 4;
+    return sclass % 2 ? (size_t) 3 << (b - 2) : (size_t) 1 << b;
 }
 
 static void base_allocator_atexit();
 
+// Return the chunk holding `addr`, or chunks.end(). Doesn't touch `addr`.
+static std::map<uintptr_t, base_chunk>::iterator base_chunk_of(uintptr_t addr) {
+    auto it = chunks.upper_bound(addr);
+    if (it == chunks.begin()) {
+        return chunks.end();
+    }
+    --it;
+    return addr - it->first < it->second.carved ? it : chunks.end();
+}
+
+// Carve a new block of class `sclass`, or return nullptr.
+static base_block* base_carve(unsigned sclass) {
+    size_t stride = sizeof(base_block) + base_class_size(sclass);
+    auto* it = carving[sclass];
+    if (!it || it->second.length - it->second.carved < stride) {
+        size_t length = stride <= BASE_CHUNK_SIZE / 16 ? BASE_CHUNK_SIZE : stride;
+        void* mem = malloc(length);
+        if (!mem) {
+            return nullptr;
+        }
+        it = &*chunks.emplace(reinterpret_cast<uintptr_t>(mem),
+                              base_chunk{stride, 0, length}).first;
+        carving[sclass] = it;
+    }
+    base_block* b = reinterpret_cast<base_block*>(it->first + it->second.carved);
+    it->second.carved += stride;
+    b->sclass = sclass;
+    return b;
+}
+
 void* base_malloc(size_t sz) {
     if (disabled) {
         return malloc(sz);
     }
-    ++disabled;
-    uintptr_t ptr = 0;
 
     static int base_alloc_atexit_installed = 0;
     if (!base_alloc_atexit_installed) {
@@ -38,55 +117,95 @@ void* base_malloc(size_t sz) {
         base_alloc_atexit_installed = 1;
     }
 
-    // try to use a previously-freed block 75% of the time
-    unsigned r = alloc_random();
-    if (r % 4 != 0) {
-        for (unsigned ntries = 0; ntries < 10 && ntries < frees.size(); ++ntries) {
-            auto& f = frees[alloc_random() % frees.size()];
-            if (f.second >= sz) {
-                allocs.insert(f);
-                ptr = f.first;
-                f = frees.back();
-                frees.pop_back();
-                break;
-            }
+    if (sz > ((size_t) 1 << 62)) {
+        return nullptr;
+    }
+    unsigned sclass = base_class(sz);
+    base_block* b = free_lists[sclass];
+    if (b) {
+        free_lists[sclass] = b->next;
+    } else {
+        b = base_carve(sclass);
+        if (!b) {
+            return nullptr;
         }
     }
+    b->check = base_check(b, true);
+    return b + 1;
+}
 
+void base_free(void* ptr) {
     if (!ptr) {
-        // need a new allocation
-        ptr = reinterpret_cast<uintptr_t>(malloc(sz ? sz : 1));
+        return;
+    }
+    // not one of ours: from malloc while we were disabled, or an invalid
+    // free, which we silently ignore, as we do a double free
+    uintptr_t addr = reinterpret_cast<uintptr_t>(ptr) - sizeof(base_block);
+    auto it = base_chunk_of(addr);
+    if (it == chunks.end() || (addr - it->first) % it->second.stride != 0) {
+        if (disabled) {
+            free(ptr);
+        }
+        return;
     }
-    if (ptr) {
-        allocs[reinterpret_cast<uintptr_t>(ptr)] = sz;
+    base_block* b = reinterpret_cast<base_block*>(addr);
+    if (b->check != base_check(b, true)) {
+        return;
     }
 
-    --disabled;
-    return reinterpret_cast<void*>(ptr);
-}
-
-void base_free(void* ptr) {
-    if (disabled || !ptr) {
-        free(ptr);
+    // to the back of the quarantine
+    b->check = base_check(b, false);
+    b->next = nullptr;
+    if (quarantine_tail) {
+        quarantine_tail->next = b;
     } else {
-        // mark free if found; if not found, invalid free: silently ignore
-        ++disabled;
-        auto it = allocs.find(reinterpret_cast<uintptr_t>(ptr));
-        if (it != allocs.end()) {
-            frees.push_back(*it);
-            allocs.erase(it);
-        }
-        --disabled;
+        quarantine_head = b;
+    }
+    quarantine_tail = b;
+    ++quarantine_blocks;
+    quarantine_bytes += base_class_size(b->sclass);
+
+    // and let the oldest out, keeping the newest freed block back
+    while (quarantine_head != quarantine_tail
+           && (quarantine_blocks > BASE_QUARANTINE_BLOCKS
+               || quarantine_bytes > BASE_QUARANTINE_BYTES)) {
+        base_block* old = quarantine_head;
+        quarantine_head = old->next;
+        --quarantine_blocks;
+        quarantine_bytes -= base_class_size(old->sclass);
+        old->next = free_lists[old->sclass];
+        free_lists[old->sclass] = old;
     }
 }
 
+bool base_contains(const void* ptr) {
+    uintptr_t addr = reinterpret_cast<uintptr_t>(ptr);
+    auto it = base_chunk_of(addr);
+    return it != chunks.end() && (addr - it->first) % it->second.stride >= sizeof(base_block);
+}
+
 void base_allocator_disable(bool d) {
     disabled = d;
 }
 
 static void base_allocator_atexit() {
-    // clean up freed memory to shut up leak detector
-    for (auto& alloc : frees) {
-        free(reinterpret_cast<void*>(alloc.first));
+    // clean up freed big blocks to shut up leak detector; chunks of small
+    // ones may still hold live blocks
+    auto release = [] (base_block* b) {
+        auto it = chunks.find(reinterpret_cast<uintptr_t>(b));
+        if (it != chunks.end() && it->second.length == it->second.stride) {
+            chunks.erase(it);
+            free(b);
+        }
+    };
+    while (base_block* b = quarantine_head) {
+        quarantine_head = b->next;
+        release(b);
+    }
+    for (unsigned sclass = 0; sclass != BASE_NCLASSES; ++sclass) {
+        while (base_block* b = free_lists[sclass]) {
+            free_lists[sclass] = b->next;
+            release(b);
+        }
     }
 }
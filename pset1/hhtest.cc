@@ -98,10 +98,6 @@ static void phase(double skew, unsigned long long count) {
 }
 
 int main(int argc, char **argv) {
-    // use the system allocator, not the base allocator
-    // (the base allocator can be slow)
-    base_allocator_disable(1);
-
     if (argc > 1 && (strcmp(argv[1], "-h") == 0
                      || strcmp(argv[1], "--help") == 0)) {
         printf("Usage: ./hhtest\n\
@@ -7,17 +7,1804 @@
 #include <cassert>
 #include <vector>    //for heavy hitters
 #include <algorithm> //for heavy hitters
-#define MAGIC_META_ID 4206969
-
-m61_statistics global_stats = {0, 0, 0, 0, 0, 0, 0, 0};
-//this is our free list
-struct header global_base = {0, 1337, 0, nullptr, nullptr, NULL, 0};
-//contains all of our heavy_hitter_item from each allocation
-std::vector<heavy_hitters_item> heavy_hitters_report_vector;
-//compares line numbers in heavy_hitter_items
+#include <map>       //for the region index
+#include <unordered_map> //for the grouped leak report
+#include <atomic>    //for thread caches
+#include <mutex>     //for thread caches
+#include <deque>     //for the guard quarantine
+#include <thread>    //for the background heap checker
+#include <chrono>
+#include <cmath>     //for sampling weights
+#include <csignal>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <execinfo.h> //for M61_LEAKS=stack
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+//size classes for the slab front-end: powers of two plus the 3/4 step
+//between each pair, 16 B up to 32 KiB. a class is the room a block needs
+//after its header, so payload + trailer byte
+#define M61_NCLASSES 23
+#define M61_MAX_SMALL 32768
+//slabs are carved out of base_malloc chunks at least this big
+#define M61_CHUNK_SIZE 65536
+#define M61_TRAILER 1
+//with M61_CANARY, blocks get canaries this wide (rounded up to 8) on each side
+#define M61_CANARY_MIN 8
+#define M61_CANARY_MAX 64
+//anything this big fails outright, keeps the size math from overflowing
+#define M61_MAX_SIZE ((size_t)1 << 47)
+//regions own whole pages so the page map can point each page at one region
+#define M61_PAGE_SHIFT 12
+#define M61_PAGE_SIZE ((size_t)1 << M61_PAGE_SHIFT)
+//M61_CACHELINE pads slab slots to whole lines and lines their payloads up,
+//so no two payloads share a cache line
+#define M61_CACHE_LINE 64
+//size class of a block sitting against its own guard page
+#define M61_GUARDED (M61_NCLASSES + 1)
+//guard blocks are carved out of mmap arenas this big
+#define M61_GUARD_ARENA ((size_t)64 << 20)
+//default cap on freed guard block bytes kept inaccessible
+#define M61_GUARD_QUARANTINE ((size_t)16 << 20)
+//default number of events in the M61_TRACE ring
+#define M61_TRACE_EVENTS ((size_t)1 << 20)
+//calloc this big gets its own mmap, whose pages the kernel hands over
+//already zeroed, so we never touch them
+#define M61_ZERO_MAP ((size_t)256 << 10)
+//freed zeroed mappings parked for reuse are capped at this many bytes
+#define M61_ZERO_PARKED ((size_t)256 << 20)
+//zeroing this much goes around the cache with non-temporal stores
+#define M61_ZERO_STREAM ((size_t)64 << 10)
+
+static_assert(sizeof(header) == 16, "m61 headers are 16 bytes");
+static_assert(M61_GUARDED + 1 == M61_STATS_CLASSES, "every size class gets an M61_STATS row");
+
+struct m61_thread_cache;
+
+//a region is one base_malloc allocation we carve blocks from: either a slab
+//chunk of equal slots for one size class, or a single large block
+struct m61_region
+{
+    uintptr_t base;                          //address of the first slot, page aligned
+    size_t length;                           //bytes covered by slots
+    size_t slot_size;                        //header + class size (whole block when large)
+    size_t offset;                           //where the first header sits, only guard blocks aren't at 0
+    unsigned sclass;                         //size class, M61_NCLASSES for a large block
+    unsigned nslots;                         //slots in this region
+    unsigned ncarved;                        //slots handed out at least once (owner only)
+    void *mem;                               //what base_malloc gave us
+    size_t mapped;                           //length of our own mmap for a zeroed large block, else 0
+    m61_thread_cache *owner;                 //cache whose free lists our slots go back to
+    std::vector<std::atomic<uint64_t>> live; //one bit per slot, set while allocated
+    std::vector<uint32_t> born;              //owner's allocation tick when each slot was allocated
+    std::vector<uint32_t> stack;             //M61_LEAKS=stack: m61_stack_id of each slot's allocation
+    m61_region *next_spare;                  //recycled large region descriptors
+};
+
+//freed slab slots are chained through their payload
+struct m61_free_slot
+{
+    m61_free_slot *next;
+    m61_region *region;
+};
+
+//per-class state: a FIFO of freed slots (oldest reused first so a freed
+//block sits around for a while, which keeps double frees detectable) and
+//the chunk we're still carving fresh slots from
+struct m61_class_state
+{
+    m61_free_slot *free_head;
+    m61_free_slot *free_tail;
+    m61_region *carving;
+};
+
+//stat counters are only written by the thread that owns them, so a plain
+//load + store is enough; other threads just read them when merging
+struct m61_counters
+{
+    std::atomic<unsigned long long> nactive;
+    std::atomic<unsigned long long> active_size;
+    std::atomic<unsigned long long> ntotal;
+    std::atomic<unsigned long long> total_size;
+    std::atomic<unsigned long long> nfail;
+    std::atomic<unsigned long long> fail_size;
+};
+
+//heavy hitters are tracked with a byte-weighted Space-Saving sketch: a
+//fixed set of counters in a min-heap plus a little hash table from site to
+//heap slot. a site we're already counting just gets bumped; a new one
+//evicts the smallest counter and inherits its count as error. estimates
+//only ever overcount, by at most (bytes seen / M61_HH_COUNTERS), so any
+//site with more than 1/M61_HH_COUNTERS of the bytes is always in there,
+//which is way under the 20% we report on
+#define M61_HH_COUNTERS 64
+#define M61_HH_TABLE 128
+struct m61_hh_entry
+{
+    unsigned site;
+    unsigned long long bytes; //estimated bytes, never below the real count
+    unsigned long long error; //how much of `bytes` might belong to others
+    unsigned hslot;           //where our site sits in the hash table
+};
+
+struct m61_hh_sketch
+{
+    m61_hh_entry heap[M61_HH_COUNTERS]; //min-heap on bytes
+    unsigned n;
+    unsigned short table[M61_HH_TABLE]; //site -> heap index + 1, 0 if empty
+};
+
+//allocation sites are interned into small consecutive ids. finding a
+//site's id is a lock-free probe of an open-addressing table; only new
+//sites take site_lock. a slot's id is written last, so a reader that sees
+//it also sees the file and line. the table doubles when half full and old
+//tables are never freed, so a reader on an old one is still safe, it just
+//might miss a new site and go take the lock
+struct m61_site
+{
+    const char *file;
+    long line;
+};
+
+struct m61_site_slot
+{
+    std::atomic<unsigned> site; //0 while empty
+    const char *file;
+    long line;
+};
+
+struct m61_site_table
+{
+    size_t mask;
+    size_t count;
+    m61_site_slot *slots;
+};
+
+//sites are also published to an append-only directory of pages that never
+//move, so an id's file and line can be read without site_lock: the page
+//and entry are written before the count that covers them is released
+#define M61_SITE_PAGE 1024
+#define M61_SITE_PAGES 4096
+
+//everything a thread allocates from without taking a lock. frees from other
+//threads come back through `remote_frees`, a lock-free MPSC stack: any
+//thread pushes with a CAS, only the owner pops and it takes the whole stack
+//at once so there's no ABA. when a thread exits its cache is abandoned and
+//the next new thread adopts it, chunks and pending remote frees included
+struct m61_thread_cache
+{
+    m61_class_state classes[M61_NCLASSES];
+    std::atomic<m61_free_slot *> remote_frees;
+    m61_counters stats;
+    m61_hh_sketch heavy_hitters;
+    //live blocks and bytes by size class and live bytes by site, kept like
+    //`stats`, for M61_STATS
+    std::atomic<unsigned long long> class_blocks[M61_STATS_CLASSES];
+    std::atomic<unsigned long long> class_bytes[M61_STATS_CLASSES];
+    std::atomic<unsigned long long> site_bytes[M61_STATS_SITES];
+    //allocations by size and frees by lifetime, for m61_get_histograms
+    std::atomic<unsigned long long> size_hist[M61_HIST_BUCKETS];
+    std::atomic<unsigned long long> lifetime_hist[M61_HIST_BUCKETS];
+    long long sample_left;                   //bytes to go before the next sampled allocation
+    uint64_t sample_rng;                     //xorshift state for sample intervals, 0 until seeded
+    bool abandoned;                          //protected by cache_lock
+    m61_thread_cache *next;                  //registry of every cache ever made
+};
+
+//page map: three-level radix tree from page number to the region owning
+//that page. written under region_lock, read without any lock, so free can
+//find a block's region in O(1) from any thread
+#define M61_PAGEMAP_BITS 12
+#define M61_PAGEMAP_FANOUT ((size_t)1 << M61_PAGEMAP_BITS)
+struct m61_pagemap_leaf
+{
+    std::atomic<m61_region *> region[M61_PAGEMAP_FANOUT];
+};
+struct m61_pagemap_mid
+{
+    std::atomic<m61_pagemap_leaf *> leaf[M61_PAGEMAP_FANOUT];
+};
+static std::atomic<m61_pagemap_mid *> pagemap_root[M61_PAGEMAP_FANOUT];
+
+//region_lock covers the base allocator (which isn't thread safe), page map
+//writes, region_index and the spare descriptor list
+static std::mutex region_lock;
+//address-ordered index of every region, only used to walk them in order
+static std::map<uintptr_t, m61_region *> region_index;
+//large region descriptors are recycled, never deleted, so a racing page
+//map lookup can never touch freed memory
+static m61_region *spare_regions;
+//freed zeroed large blocks' mappings, parked for reuse. their pages past
+//the first are dropped, so they read back as zero, and the old header
+//stays readable for spotting a double free. indexed by address, by length
+//for best fit and by age; past M61_ZERO_PARKED bytes the oldest are unmapped
+struct m61_zero_span
+{
+    size_t mapped;
+    uint64_t age;
+};
+static std::map<uintptr_t, m61_zero_span> zero_spans;
+static std::multimap<size_t, uintptr_t> zero_span_fit;
+static std::map<uint64_t, uintptr_t> zero_span_age;
+static size_t zero_parked;
+static uint64_t zero_ages;
+
+//cache_lock covers the cache registry
+static std::mutex cache_lock;
+static m61_thread_cache *all_caches;
+static thread_local m61_thread_cache *tcache;
+static thread_local bool tcache_exited;
+
+//site_lock covers adding sites. ids index `sites`, 0 is never used
+static std::mutex site_lock;
+static std::vector<m61_site> sites(1, m61_site{"?", 0});
+static std::atomic<m61_site_table *> site_table;
+static std::atomic<m61_site *> site_pages[M61_SITE_PAGES];
+static std::atomic<unsigned> nsites_published;
+
+//smallest and largest payload addresses handed out, only ever widened
+static std::atomic<uintptr_t> heap_min;
+static std::atomic<uintptr_t> heap_max;
+
+//runtime options, read from the environment the first time m61 is used
+struct m61_options
+{
+    bool guard;        //M61_GUARD: put every block against a guard page
+    size_t quarantine; //M61_GUARD_QUARANTINE: bytes of freed guard blocks to hold back
+    size_t canary;     //M61_CANARY: canary bytes on each side of a payload, 0 for just the '@'
+    unsigned interval; //M61_CHECK_INTERVAL: ms between background heap checks, 0 for none
+    m61_trace_header *trace; //M61_TRACE: where events get logged, if anywhere
+    size_t sample;     //M61_SAMPLE: mean bytes between allocations tracked by site, 0 for all
+    m61_stats_segment *stats; //M61_STATS: where live statistics get published, if anywhere
+    unsigned leaks;    //M61_LEAKS: M61_LEAKS_BLOCK, _SITE or _STACK
+    bool cacheline;    //M61_CACHELINE: give every payload cache lines of its own
+};
+
+//leak report styles: a line per block, or a line per site (and backtrace)
+//with byte and object totals, biggest first
+#define M61_LEAKS_BLOCK 0
+#define M61_LEAKS_SITE 1
+#define M61_LEAKS_STACK 2
+
+static void m61_guard_install();
+static void m61_start_checker(unsigned interval);
+static void m61_start_publisher(m61_stats_segment *segment, unsigned interval);
+
+/// m61_map_file(path, length)
+///    Create `length` byte file `path` and map it shared, or return nullptr.
+static void *m61_map_file(const char *path, size_t length)
+{
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+    void *mem = MAP_FAILED;
+    if (ftruncate(fd, length) == 0)
+    {
+        mem = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    return mem == MAP_FAILED ? nullptr : mem;
+}
+
+/// m61_trace_open(path, capacity)
+///    Create trace file `path` with room for `capacity` events and map it.
+///    Returns nullptr (after saying why) if that doesn't work out.
+static m61_trace_header *m61_trace_open(const char *path, size_t capacity)
+{
+    size_t length = sizeof(m61_trace_header) + capacity * sizeof(m61_trace_event);
+    void *mem = capacity ? m61_map_file(path, length) : nullptr;
+    if (mem == nullptr)
+    {
+        fprintf(stderr, "m61: can't trace to %s\n", path);
+        return nullptr;
+    }
+    m61_trace_header *trace = (m61_trace_header *)mem;
+    memcpy(trace->magic, M61_TRACE_MAGIC, sizeof(trace->magic));
+    trace->version = M61_TRACE_VERSION;
+    trace->event_size = sizeof(m61_trace_event);
+    trace->capacity = capacity;
+    trace->next = 0;
+    return trace;
+}
+
+static m61_options m61_read_options()
+{
+    m61_options opts;
+    const char *value = getenv("M61_GUARD");
+    opts.guard = value && *value && strcmp(value, "0") != 0;
+    value = getenv("M61_GUARD_QUARANTINE");
+    opts.quarantine = value ? strtoull(value, nullptr, 0) : M61_GUARD_QUARANTINE;
+    value = getenv("M61_CANARY");
+    opts.canary = value ? strtoull(value, nullptr, 0) : 0;
+    if (opts.canary)
+    {
+        opts.canary = std::min<size_t>(std::max<size_t>((opts.canary + 7) & ~(size_t)7, M61_CANARY_MIN), M61_CANARY_MAX);
+    }
+    value = getenv("M61_SAMPLE");
+    opts.sample = value ? strtoull(value, nullptr, 0) : 0;
+    value = getenv("M61_CHECK_INTERVAL");
+    opts.interval = value ? strtoul(value, nullptr, 0) : 0;
+    opts.trace = nullptr;
+    if ((value = getenv("M61_TRACE")) && *value)
+    {
+        const char *events = getenv("M61_TRACE_EVENTS");
+        opts.trace = m61_trace_open(value, events ? strtoull(events, nullptr, 0) : M61_TRACE_EVENTS);
+    }
+    value = getenv("M61_CACHELINE");
+    opts.cacheline = value && *value && strcmp(value, "0") != 0;
+    value = getenv("M61_LEAKS");
+    opts.leaks = M61_LEAKS_BLOCK;
+    if (value && strcmp(value, "site") == 0)
+    {
+        opts.leaks = M61_LEAKS_SITE;
+    }
+    else if (value && strcmp(value, "stack") == 0)
+    {
+        opts.leaks = M61_LEAKS_STACK;
+    }
+    opts.stats = nullptr;
+    if ((value = getenv("M61_STATS")) && *value)
+    {
+        opts.stats = (m61_stats_segment *)m61_map_file(value, sizeof(m61_stats_segment));
+        if (opts.stats == nullptr)
+        {
+            fprintf(stderr, "m61: can't publish statistics to %s\n", value);
+        }
+    }
+    if (opts.guard)
+    {
+        m61_guard_install();
+    }
+    if (opts.interval)
+    {
+        m61_start_checker(opts.interval);
+    }
+    if (opts.stats)
+    {
+        value = getenv("M61_STATS_INTERVAL");
+        m61_start_publisher(opts.stats, value ? strtoul(value, nullptr, 0) : 100);
+    }
+    return opts;
+}
+
+static inline const m61_options &m61_opts()
+{
+    static const m61_options opts = m61_read_options();
+    return opts;
+}
+
+//trace thread numbers, handed out on a thread's first event
+static std::atomic<unsigned> trace_threads;
+static thread_local unsigned trace_thread;
+
+/// m61_trace_claim(trace)
+///    Reserve the next event of `trace`. Claiming before an operation
+///    that releases a block keeps its event ahead of any later event that
+///    reuses the address.
+static m61_trace_event *m61_trace_claim(m61_trace_header *trace)
+{
+    uint64_t i = __atomic_fetch_add(&trace->next, 1, __ATOMIC_RELAXED);
+    return (m61_trace_event *)(trace + 1) + i % trace->capacity;
+}
+
+/// m61_trace_fill(event, op, addr, old_addr, sz, file, line)
+///    Fill in a claimed trace event.
+static void m61_trace_fill(m61_trace_event *event, unsigned op, void *addr, void *old_addr, size_t sz,
+                           const char *file, long line)
+{
+    if (trace_thread == 0)
+    {
+        trace_thread = trace_threads.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    event->time = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    event->addr = (uintptr_t)addr;
+    event->old_addr = (uintptr_t)old_addr;
+    event->size = sz;
+    event->site = m61_site_id(file, line);
+    event->thread = trace_thread - 1;
+    event->op = op;
+}
+
+/// m61_lead()
+///    Return how far a payload starts past its header.
+static inline size_t m61_lead()
+{
+    return sizeof(header) + m61_opts().canary;
+}
+
+//guard mode: every block gets a run of pages to itself, followed by one
+//PROT_NONE guard page, with the payload pushed right up against the guard
+//page so reading or writing even one byte past the end faults on the spot.
+//runs come out of big PROT_NONE mmap arenas, so a malloc costs an
+//mprotect, not an mmap. a freed run goes PROT_NONE too and waits in a FIFO
+//quarantine capped at opts.quarantine bytes, so touching freed memory
+//faults and a double free is still recognized. once it leaves quarantine
+//its pages are dropped and the run is reused. guard_lock covers all of it
+static std::mutex guard_lock;
+static uintptr_t guard_next;                          //unused part of the newest arena
+static uintptr_t guard_end;
+static std::multimap<size_t, uintptr_t> guard_runs;  //free runs by page count, not coalesced
+static std::deque<m61_region *> guard_quarantine;
+static size_t guard_quarantined;                      //bytes in guard_quarantine
+
+//compares sites in heavy_hitter_items
 bool cus_cmp(const heavy_hitters_item &x, const heavy_hitters_item &y)
 {
-    return x.line < y.line;
+    return x.site < y.site;
+}
+
+static unsigned m61_hh_hash(unsigned site)
+{
+    return (site * 0x9E3779B1U) >> (32 - 7);
+}
+
+/// m61_hh_lookup(sketch, site)
+///    Return the hash slot holding `site`, or the empty slot where it
+///    would go.
+static unsigned m61_hh_lookup(m61_hh_sketch &sketch, unsigned site)
+{
+    unsigned i = m61_hh_hash(site);
+    while (sketch.table[i])
+    {
+        if (sketch.heap[sketch.table[i] - 1].site == site)
+        {
+            break;
+        }
+        i = (i + 1) & (M61_HH_TABLE - 1);
+    }
+    return i;
+}
+
+static void m61_hh_swap(m61_hh_sketch &sketch, unsigned i, unsigned j)
+{
+    std::swap(sketch.heap[i], sketch.heap[j]);
+    sketch.table[sketch.heap[i].hslot] = i + 1;
+    sketch.table[sketch.heap[j].hslot] = j + 1;
+}
+
+static void m61_hh_sift_down(m61_hh_sketch &sketch, unsigned i)
+{
+    for (;;)
+    {
+        unsigned smallest = i;
+        for (unsigned child = 2 * i + 1; child <= 2 * i + 2 && child < sketch.n; ++child)
+        {
+            if (sketch.heap[child].bytes < sketch.heap[smallest].bytes)
+            {
+                smallest = child;
+            }
+        }
+        if (smallest == i)
+        {
+            return;
+        }
+        m61_hh_swap(sketch, i, smallest);
+        i = smallest;
+    }
+}
+
+/// m61_hh_unlink(sketch, hslot)
+///    Empty hash slot `hslot`, shifting later entries of its probe run
+///    back so lookups still find them.
+static void m61_hh_unlink(m61_hh_sketch &sketch, unsigned hslot)
+{
+    unsigned hole = hslot;
+    sketch.table[hole] = 0;
+    for (unsigned j = (hole + 1) & (M61_HH_TABLE - 1); sketch.table[j]; j = (j + 1) & (M61_HH_TABLE - 1))
+    {
+        m61_hh_entry &e = sketch.heap[sketch.table[j] - 1];
+        unsigned home = m61_hh_hash(e.site);
+        //can this entry live in the hole? only if its home isn't in (hole, j]
+        bool stays = hole < j ? (home > hole && home <= j) : (home > hole || home <= j);
+        if (!stays)
+        {
+            sketch.table[hole] = sketch.table[j];
+            e.hslot = hole;
+            sketch.table[j] = 0;
+            hole = j;
+        }
+    }
+}
+
+/// m61_hh_add(sketch, site, bytes)
+///    Count `bytes` more for allocation site `site`. O(log k).
+static void m61_hh_add(m61_hh_sketch &sketch, unsigned site, size_t bytes)
+{
+    unsigned hslot = m61_hh_lookup(sketch, site);
+    if (sketch.table[hslot])
+    {
+        unsigned i = sketch.table[hslot] - 1;
+        sketch.heap[i].bytes += bytes;
+        m61_hh_sift_down(sketch, i);
+        return;
+    }
+    if (sketch.n < M61_HH_COUNTERS)
+    {
+        //room for a new counter, sift it up to where it belongs
+        unsigned i = sketch.n++;
+        sketch.heap[i] = {site, bytes, 0, hslot};
+        sketch.table[hslot] = i + 1;
+        while (i > 0 && sketch.heap[(i - 1) / 2].bytes > sketch.heap[i].bytes)
+        {
+            m61_hh_swap(sketch, i, (i - 1) / 2);
+            i = (i - 1) / 2;
+        }
+        return;
+    }
+    //full, take over the smallest counter
+    unsigned long long min = sketch.heap[0].bytes;
+    m61_hh_unlink(sketch, sketch.heap[0].hslot);
+    hslot = m61_hh_lookup(sketch, site);
+    sketch.heap[0] = {site, min + bytes, min, hslot};
+    sketch.table[hslot] = 1;
+    m61_hh_sift_down(sketch, 0);
+}
+
+static inline void m61_bump(std::atomic<unsigned long long> &counter, unsigned long long delta)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+//abandons this thread's cache when the thread exits
+struct m61_thread_exit
+{
+    m61_thread_cache *cache;
+    ~m61_thread_exit()
+    {
+        std::lock_guard<std::mutex> guard(cache_lock);
+        cache->abandoned = true;
+        tcache = nullptr;
+        tcache_exited = true;
+    }
+};
+static thread_local m61_thread_exit thread_exit_hook;
+
+/// m61_attach_cache()
+///    Give this thread a cache, adopting an abandoned one if there is one.
+static m61_thread_cache *m61_attach_cache()
+{
+    m61_thread_cache *cache;
+    {
+        std::lock_guard<std::mutex> guard(cache_lock);
+        cache = all_caches;
+        while (cache && !cache->abandoned)
+        {
+            cache = cache->next;
+        }
+        if (cache == nullptr)
+        {
+            cache = new m61_thread_cache();
+            cache->next = all_caches;
+            all_caches = cache;
+        }
+        cache->abandoned = false;
+    }
+    tcache = cache;
+    //once our thread_locals are torn down we can't register again, the
+    //cache just stays attached until the process ends
+    if (!tcache_exited)
+    {
+        thread_exit_hook.cache = cache;
+    }
+    return cache;
+}
+
+static inline m61_thread_cache *m61_get_cache()
+{
+    return tcache ? tcache : m61_attach_cache();
+}
+
+static size_t m61_site_hash(const char *file, long line)
+{
+    return ((uintptr_t)file * 0x9E3779B97F4A7C15ULL ^ (uint64_t)line * 0xC2B2AE3D27D4EB4FULL) >> 20;
+}
+
+/// m61_site_probe(table, file, line)
+///    Return the slot of `table` holding `file`:`line`, or the empty slot
+///    where it would go.
+static m61_site_slot *m61_site_probe(m61_site_table *table, const char *file, long line)
+{
+    size_t i = m61_site_hash(file, line) & table->mask;
+    for (;;)
+    {
+        m61_site_slot *slot = &table->slots[i];
+        if (slot->site.load(std::memory_order_acquire) == 0 || (slot->file == file && slot->line == line))
+        {
+            return slot;
+        }
+        i = (i + 1) & table->mask;
+    }
+}
+
+unsigned m61_site_id(const char *file, long line)
+{
+    m61_site_table *table = site_table.load(std::memory_order_acquire);
+    if (table)
+    {
+        if (unsigned site = m61_site_probe(table, file, line)->site.load(std::memory_order_acquire))
+        {
+            return site;
+        }
+    }
+
+    //new site (or one added since we looked), take the lock
+    std::lock_guard<std::mutex> guard(site_lock);
+    table = site_table.load(std::memory_order_relaxed);
+    if (table == nullptr || 2 * (table->count + 1) > table->mask + 1)
+    {
+        //grow, copy everything over and publish the new table
+        m61_site_table *bigger = new m61_site_table;
+        bigger->mask = table ? 2 * table->mask + 1 : 1023;
+        bigger->count = 0;
+        bigger->slots = new m61_site_slot[bigger->mask + 1]();
+        for (unsigned site = 1; site < sites.size(); ++site)
+        {
+            m61_site_slot *slot = m61_site_probe(bigger, sites[site].file, sites[site].line);
+            slot->file = sites[site].file;
+            slot->line = sites[site].line;
+            slot->site.store(site, std::memory_order_relaxed);
+            ++bigger->count;
+        }
+        site_table.store(bigger, std::memory_order_release);
+        table = bigger;
+    }
+    m61_site_slot *slot = m61_site_probe(table, file, line);
+    unsigned site = slot->site.load(std::memory_order_relaxed);
+    if (site == 0)
+    {
+        site = sites.size();
+        sites.push_back({file, line});
+        if (site < M61_SITE_PAGE * M61_SITE_PAGES)
+        {
+            m61_site *page = site_pages[site / M61_SITE_PAGE].load(std::memory_order_relaxed);
+            if (page == nullptr)
+            {
+                page = new m61_site[M61_SITE_PAGE];
+                site_pages[site / M61_SITE_PAGE].store(page, std::memory_order_relaxed);
+            }
+            page[site % M61_SITE_PAGE] = {file, line};
+            nsites_published.store(site + 1, std::memory_order_release);
+        }
+        slot->file = file;
+        slot->line = line;
+        slot->site.store(site, std::memory_order_release);
+        ++table->count;
+    }
+    return site;
+}
+
+void m61_site_location(unsigned site, const char **file, long *line)
+{
+    if (site == 0 || site >= nsites_published.load(std::memory_order_acquire))
+    {
+        *file = "?";
+        *line = 0;
+        return;
+    }
+    const m61_site &where = site_pages[site / M61_SITE_PAGE].load(std::memory_order_relaxed)[site % M61_SITE_PAGE];
+    *file = where.file;
+    *line = where.line;
+}
+
+//M61_LEAKS=stack: allocation backtraces, interned like sites. ids index
+//`stacks`, 0 is none. the public entry points capture the backtrace into
+//current_stack, so it starts at their caller
+#define M61_STACK_DEPTH 16
+struct m61_stack
+{
+    uint64_t hash;
+    unsigned depth;
+    void *frames[M61_STACK_DEPTH];
+};
+static std::mutex stack_lock;
+static std::vector<m61_stack> stacks(1);
+static std::unordered_multimap<uint64_t, unsigned> stack_index;
+static thread_local unsigned current_stack;
+
+/// m61_stack_id()
+///    Return the id of the backtrace that called our caller, interning it
+///    on first use. Never inlined, so the frames to skip are always ours
+///    and our caller's.
+__attribute__((noinline)) static unsigned m61_stack_id()
+{
+    void *frames[M61_STACK_DEPTH + 2];
+    int n = backtrace(frames, M61_STACK_DEPTH + 2);
+    m61_stack stack = {};
+    stack.depth = n > 2 ? n - 2 : 0;
+    memcpy(stack.frames, frames + 2, stack.depth * sizeof(void *));
+    stack.hash = 0xCBF29CE484222325ULL;
+    for (unsigned i = 0; i != stack.depth; ++i)
+    {
+        stack.hash = (stack.hash ^ (uintptr_t)stack.frames[i]) * 0x100000001B3ULL;
+    }
+
+    std::lock_guard<std::mutex> guard(stack_lock);
+    auto range = stack_index.equal_range(stack.hash);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        m61_stack &known = stacks[it->second];
+        if (known.depth == stack.depth && memcmp(known.frames, stack.frames, stack.depth * sizeof(void *)) == 0)
+        {
+            return it->second;
+        }
+    }
+    stacks.push_back(stack);
+    stack_index.emplace(stack.hash, stacks.size() - 1);
+    return stacks.size() - 1;
+}
+
+/// m61_note_stack()
+///    Remember the backtrace of the public entry point we're inlined into
+///    for the block it's about to hand out, if M61_LEAKS=stack wants it.
+__attribute__((always_inline)) static inline void m61_note_stack()
+{
+    if (m61_opts().leaks == M61_LEAKS_STACK)
+    {
+        current_stack = m61_stack_id();
+    }
+}
+
+/// m61_note_extent(lo, hi)
+///    Widen [heap_min, heap_max] to cover [lo, hi].
+static void m61_note_extent(uintptr_t lo, uintptr_t hi)
+{
+    uintptr_t cur = heap_min.load(std::memory_order_relaxed);
+    while ((cur == 0 || lo < cur) && !heap_min.compare_exchange_weak(cur, lo, std::memory_order_relaxed))
+    {
+    }
+    cur = heap_max.load(std::memory_order_relaxed);
+    while (hi > cur && !heap_max.compare_exchange_weak(cur, hi, std::memory_order_relaxed))
+    {
+    }
+}
+
+/// m61_size_class(n)
+///    Return the smallest size class with room for `n` bytes.
+static unsigned m61_size_class(size_t n)
+{
+    if (n <= 16)
+    {
+        return 0;
+    }
+    //2^lg < n <= 2^(lg+1), which has two classes: 3*2^(lg-1) and 2^(lg+1)
+    unsigned lg = 63 - __builtin_clzll(n - 1);
+    unsigned sclass = 2 * (lg - 4) + 1;
+    if (n > ((size_t)3 << (lg - 1)))
+    {
+        ++sclass;
+    }
+    return sclass;
+}
+
+/// m61_class_size(sclass)
+///    Return the number of bytes blocks of size class `sclass` have room for.
+static size_t m61_class_size(unsigned sclass)
+{
+    if (sclass == 0)
+    {
+        return 16;
+    }
+    unsigned lg = (sclass - 1) / 2 + 4;
+    return sclass % 2 ? (size_t)3 << (lg - 1) : (size_t)1 << (lg + 1);
+}
+
+/// m61_slot_size(sclass)
+///    Return the bytes a slot of size class `sclass` takes, header and all.
+static size_t m61_slot_size(unsigned sclass)
+{
+    size_t slot_size = sizeof(header) + m61_class_size(sclass);
+    if (m61_opts().cacheline)
+    {
+        slot_size = (slot_size + M61_CACHE_LINE - 1) & ~(size_t)(M61_CACHE_LINE - 1);
+    }
+    return slot_size;
+}
+
+/// m61_slot_of(region, meta)
+///    Return which slot of `region` header `meta` heads.
+static inline unsigned m61_slot_of(const m61_region *region, const header *meta)
+{
+    return ((uintptr_t)meta - region->base - region->offset) / region->slot_size;
+}
+
+/// m61_header_check(meta)
+///    Return the checksum `meta` should carry. Mixing in the header's own
+///    address means a header copied somewhere else doesn't check out.
+static uint32_t m61_header_check(const header *meta)
+{
+    uint64_t word;
+    memcpy(&word, meta, sizeof(word));
+    uint64_t x = word ^ ((uint64_t)meta->site << 17) ^ ((uintptr_t)meta * 0xC2B2AE3D27D4EB4FULL);
+    x *= 0x9E3779B97F4A7C15ULL;
+    return (uint32_t)(x >> 32);
+}
+
+static bool m61_header_ok(const header *meta, unsigned state)
+{
+    return meta->state == state && meta->check == m61_header_check(meta);
+}
+
+static bool m61_slot_live(m61_region *region, unsigned slot)
+{
+    return (region->live[slot / 64].load(std::memory_order_acquire) >> (slot % 64)) & 1;
+}
+
+static void m61_set_live(m61_region *region, unsigned slot)
+{
+    region->live[slot / 64].fetch_or((uint64_t)1 << (slot % 64), std::memory_order_release);
+}
+
+/// m61_clear_live(region, slot)
+///    Mark `slot` free. Returns false if it already was, which means two
+///    threads raced to free the same block.
+static bool m61_clear_live(m61_region *region, unsigned slot)
+{
+    uint64_t mask = (uint64_t)1 << (slot % 64);
+    return region->live[slot / 64].fetch_and(~mask, std::memory_order_acq_rel) & mask;
+}
+
+/// m61_pagemap_set(region, value)
+///    Point every page of `region` at `value`. Caller holds region_lock.
+static void m61_pagemap_set(m61_region *region, m61_region *value)
+{
+    uintptr_t first = region->base >> M61_PAGE_SHIFT;
+    uintptr_t last = (region->base + region->length - 1) >> M61_PAGE_SHIFT;
+    for (uintptr_t page = first; page <= last; ++page)
+    {
+        std::atomic<m61_pagemap_mid *> &root = pagemap_root[page >> (2 * M61_PAGEMAP_BITS)];
+        m61_pagemap_mid *mid = root.load(std::memory_order_relaxed);
+        if (mid == nullptr)
+        {
+            mid = new m61_pagemap_mid();
+            root.store(mid, std::memory_order_release);
+        }
+        std::atomic<m61_pagemap_leaf *> &midp = mid->leaf[(page >> M61_PAGEMAP_BITS) & (M61_PAGEMAP_FANOUT - 1)];
+        m61_pagemap_leaf *leaf = midp.load(std::memory_order_relaxed);
+        if (leaf == nullptr)
+        {
+            leaf = new m61_pagemap_leaf();
+            midp.store(leaf, std::memory_order_release);
+        }
+        leaf->region[page & (M61_PAGEMAP_FANOUT - 1)].store(value, std::memory_order_release);
+    }
+}
+
+/// m61_find_region(ptr)
+///    Return the region containing `ptr`, or nullptr. Lock free.
+static m61_region *m61_find_region(void *ptr)
+{
+    uintptr_t page = (uintptr_t)ptr >> M61_PAGE_SHIFT;
+    if (page >> (3 * M61_PAGEMAP_BITS))
+    {
+        return nullptr;
+    }
+    m61_pagemap_mid *mid = pagemap_root[page >> (2 * M61_PAGEMAP_BITS)].load(std::memory_order_acquire);
+    if (mid == nullptr)
+    {
+        return nullptr;
+    }
+    m61_pagemap_leaf *leaf = mid->leaf[(page >> M61_PAGEMAP_BITS) & (M61_PAGEMAP_FANOUT - 1)].load(std::memory_order_acquire);
+    if (leaf == nullptr)
+    {
+        return nullptr;
+    }
+    m61_region *region = leaf->region[page & (M61_PAGEMAP_FANOUT - 1)].load(std::memory_order_acquire);
+    //pages are padded out past the last slot
+    if (region && (uintptr_t)ptr - region->base < region->length)
+    {
+        return region;
+    }
+    return nullptr;
+}
+
+/// m61_descriptor(nslots)
+///    Return a region descriptor for `nslots` slots, recycling a spare one
+///    if it only needs one. Caller holds region_lock.
+static m61_region *m61_descriptor(unsigned nslots)
+{
+    if (nslots == 1 && spare_regions)
+    {
+        m61_region *region = spare_regions;
+        spare_regions = region->next_spare;
+        return region;
+    }
+    m61_region *region = new m61_region();
+    region->live = std::vector<std::atomic<uint64_t>>((nslots + 63) / 64);
+    region->born = std::vector<uint32_t>(nslots);
+    if (m61_opts().leaks == M61_LEAKS_STACK)
+    {
+        region->stack = std::vector<uint32_t>(nslots);
+    }
+    return region;
+}
+
+/// m61_new_region(sclass, slot_size, nslots, owner, align)
+///    Get a page-aligned region of `nslots` slots from the base allocator
+///    and index it. With `align`, the first slot is pushed in so its
+///    payload is `align` aligned.
+static m61_region *m61_new_region(unsigned sclass, size_t slot_size, unsigned nslots,
+                                  m61_thread_cache *owner, size_t align = 0)
+{
+    size_t length = slot_size * nslots + (align > 1 ? align : 0);
+    size_t span = (length + M61_PAGE_SIZE - 1) & ~(M61_PAGE_SIZE - 1);
+    std::lock_guard<std::mutex> guard(region_lock);
+    void *mem = base_malloc(span + M61_PAGE_SIZE);
+    if (mem == nullptr)
+    {
+        return nullptr;
+    }
+    m61_region *region = m61_descriptor(nslots);
+    region->base = ((uintptr_t)mem + M61_PAGE_SIZE - 1) & ~(M61_PAGE_SIZE - 1);
+    region->offset = 0;
+    if (align > 1)
+    {
+        region->offset = ((region->base + m61_lead() + align - 1) & ~(align - 1)) - m61_lead() - region->base;
+    }
+    region->length = region->offset + slot_size * nslots;
+    region->slot_size = slot_size;
+    region->sclass = sclass;
+    region->nslots = nslots;
+    region->ncarved = 0;
+    region->mem = mem;
+    region->mapped = 0;
+    region->owner = owner;
+    region_index.emplace(region->base, region);
+    m61_pagemap_set(region, region);
+    return region;
+}
+
+/// m61_unpark(base)
+///    Take the parked zeroed mapping at `base` out of zero_spans. Caller
+///    holds region_lock.
+static void m61_unpark(uintptr_t base)
+{
+    auto it = zero_spans.find(base);
+    auto fit = zero_span_fit.equal_range(it->second.mapped);
+    while (fit.first->second != base)
+    {
+        ++fit.first;
+    }
+    zero_span_fit.erase(fit.first);
+    zero_span_age.erase(it->second.age);
+    zero_parked -= it->second.mapped;
+    zero_spans.erase(it);
+}
+
+/// m61_parked(addr)
+///    Return true if `addr` is in a parked zeroed mapping. Caller holds
+///    region_lock.
+static bool m61_parked(uintptr_t addr)
+{
+    auto it = zero_spans.upper_bound(addr);
+    if (it == zero_spans.begin())
+    {
+        return false;
+    }
+    --it;
+    return addr - it->first < it->second.mapped;
+}
+
+/// m61_new_zeroed_region(span, owner)
+///    Index a region of `span` bytes (whole pages) for one large block
+///    whose pages all read as zero, from zero_spans or a fresh mmap.
+static m61_region *m61_new_zeroed_region(size_t span, m61_thread_cache *owner)
+{
+    std::lock_guard<std::mutex> guard(region_lock);
+    uintptr_t base = 0;
+    size_t mapped = span;
+    //don't let a small block pin a mapping much bigger than it
+    auto it = zero_span_fit.lower_bound(span);
+    if (it != zero_span_fit.end() && it->first / 2 <= span)
+    {
+        mapped = it->first;
+        base = it->second;
+        m61_unpark(base);
+        //only the old header's page still has anything in it
+        memset((void *)base, 0, M61_PAGE_SIZE);
+    }
+    else
+    {
+        void *mem = mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED)
+        {
+            return nullptr;
+        }
+        base = (uintptr_t)mem;
+    }
+    m61_region *region = m61_descriptor(1);
+    region->base = base;
+    region->length = mapped;
+    region->slot_size = mapped;
+    region->offset = 0;
+    region->sclass = M61_NCLASSES;
+    region->nslots = 1;
+    region->ncarved = 1;
+    region->mem = nullptr;
+    region->mapped = mapped;
+    region->owner = owner;
+    region_index.emplace(region->base, region);
+    m61_pagemap_set(region, region);
+    return region;
+}
+
+/// m61_release_region(region)
+///    Hand a large block's region back to the base allocator, or drop a
+///    zeroed one's pages and park its mapping in zero_spans. Guard blocks
+///    have no `mem`, their pages belong to the guard arenas.
+static void m61_release_region(m61_region *region)
+{
+    if (region->mapped)
+    {
+        //the first page keeps the FREED header
+        madvise((void *)(region->base + M61_PAGE_SIZE), region->mapped - M61_PAGE_SIZE, MADV_DONTNEED);
+    }
+    std::lock_guard<std::mutex> guard(region_lock);
+    m61_pagemap_set(region, nullptr);
+    region_index.erase(region->base);
+    if (region->mem)
+    {
+        base_free(region->mem);
+    }
+    else if (region->mapped)
+    {
+        uint64_t age = zero_ages++;
+        zero_spans.emplace(region->base, m61_zero_span{region->mapped, age});
+        zero_span_fit.emplace(region->mapped, region->base);
+        zero_span_age.emplace(age, region->base);
+        zero_parked += region->mapped;
+        //a run of ever bigger callocs never reuses a span, so let the
+        //oldest go. a double free of one is then just "not allocated"
+        while (zero_parked > M61_ZERO_PARKED)
+        {
+            uintptr_t oldest = zero_span_age.begin()->second;
+            size_t length = zero_spans[oldest].mapped;
+            m61_unpark(oldest);
+            munmap((void *)oldest, length);
+        }
+    }
+    region->next_spare = spare_regions;
+    spare_regions = region;
+}
+
+/// m61_guard_take(npages)
+///    Return the address of `npages` free PROT_NONE guard arena pages, or 0.
+///    Caller holds guard_lock.
+static uintptr_t m61_guard_take(size_t npages)
+{
+    //best fit among the runs out of quarantine, splitting off the rest
+    auto it = guard_runs.lower_bound(npages);
+    if (it != guard_runs.end())
+    {
+        size_t have = it->first;
+        uintptr_t run = it->second;
+        guard_runs.erase(it);
+        if (have > npages)
+        {
+            guard_runs.emplace(have - npages, run + (npages << M61_PAGE_SHIFT));
+        }
+        return run;
+    }
+    size_t bytes = npages << M61_PAGE_SHIFT;
+    if (bytes > guard_end - guard_next)
+    {
+        size_t length = std::max(bytes, M61_GUARD_ARENA);
+        void *mem = mmap(nullptr, length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (mem == MAP_FAILED)
+        {
+            return 0;
+        }
+        //whatever was left of the old arena is still good for smaller blocks
+        if (guard_end > guard_next)
+        {
+            guard_runs.emplace((guard_end - guard_next) >> M61_PAGE_SHIFT, guard_next);
+        }
+        guard_next = (uintptr_t)mem;
+        guard_end = guard_next + length;
+    }
+    uintptr_t run = guard_next;
+    guard_next += bytes;
+    return run;
+}
+
+/// m61_guard_alloc(cache, sz, region, align)
+///    Guard mode's m61_alloc_block: a block of exactly `sz` bytes ending
+///    at a guard page (as near as `align` allows), storing its region in
+///    `region`.
+static header *m61_guard_alloc(m61_thread_cache *cache, size_t sz, m61_region *&region,
+                               size_t align = 0)
+{
+    if (sz >= M61_MAX_SIZE)
+    {
+        return nullptr;
+    }
+    //8 byte alignment like everywhere else, 16 if the size is a multiple
+    //of it. the up to 7 bytes of slack before the guard page get trailer
+    //bytes, so the payload ends flush with the guard page whenever it can
+    align = std::max<size_t>(align, sz % 16 ? 8 : 16);
+    size_t npages = (m61_lead() + sz + align - 1 + M61_PAGE_SIZE - 1) >> M61_PAGE_SHIFT;
+    size_t length = npages << M61_PAGE_SHIFT;
+    std::lock_guard<std::mutex> guard(guard_lock);
+    uintptr_t run = m61_guard_take(npages + 1);
+    if (run == 0)
+    {
+        return nullptr;
+    }
+    if (mprotect((void *)run, length, PROT_READ | PROT_WRITE) != 0)
+    {
+        guard_runs.emplace(npages + 1, run);
+        return nullptr;
+    }
+    uintptr_t meta = ((run + length - sz) & ~(uintptr_t)(align - 1)) - m61_lead();
+    std::lock_guard<std::mutex> region_guard(region_lock);
+    region = m61_descriptor(1);
+    region->base = run;
+    region->length = length;
+    region->slot_size = length;
+    region->offset = meta - run;
+    region->sclass = M61_GUARDED;
+    region->nslots = 1;
+    region->ncarved = 1;
+    region->mem = nullptr;
+    region->mapped = 0;
+    region->owner = cache;
+    region_index.emplace(region->base, region);
+    m61_pagemap_set(region, region);
+    return (header *)meta;
+}
+
+/// m61_guard_release(region)
+///    Put a freed guard block in quarantine, and let the oldest blocks out
+///    of quarantine if it's over its cap.
+static void m61_guard_release(m61_region *region)
+{
+    std::lock_guard<std::mutex> guard(guard_lock);
+    mprotect((void *)region->base, region->length, PROT_NONE);
+    guard_quarantine.push_back(region);
+    guard_quarantined += region->length;
+    while (guard_quarantined > m61_opts().quarantine)
+    {
+        m61_region *oldest = guard_quarantine.front();
+        guard_quarantine.pop_front();
+        guard_quarantined -= oldest->length;
+        uintptr_t run = oldest->base;
+        size_t npages = (oldest->length >> M61_PAGE_SHIFT) + 1;
+        madvise((void *)run, oldest->length, MADV_DONTNEED);
+        m61_release_region(oldest);
+        guard_runs.emplace(npages, run);
+    }
+}
+
+/// m61_fault_puts(buf, n, size, str)
+///    Append `str` to the `size` byte buffer `buf` at `*n`, for the fault
+///    handler, which can't use printf.
+static void m61_fault_puts(char *buf, size_t *n, size_t size, const char *str)
+{
+    while (*str && *n < size)
+    {
+        buf[(*n)++] = *str++;
+    }
+}
+
+/// m61_fault_putu(buf, n, size, value, base)
+///    Append `value` in decimal or, if `base` is 16, as 0x-prefixed hex.
+static void m61_fault_putu(char *buf, size_t *n, size_t size, uintptr_t value, unsigned base)
+{
+    char digits[24];
+    size_t i = sizeof(digits);
+    digits[--i] = 0;
+    do
+    {
+        digits[--i] = "0123456789abcdef"[value % base];
+        value /= base;
+    } while (value != 0);
+    if (base == 16)
+    {
+        m61_fault_puts(buf, n, size, "0x");
+    }
+    m61_fault_puts(buf, n, size, digits + i);
+}
+
+/// m61_guard_fault(sig, info, context)
+///    SIGSEGV handler for guard mode. If the fault hit a guard page or a
+///    quarantined block, say which block on stderr, then die of the
+///    signal with the default action. Only async-signal-safe calls here.
+static void m61_guard_fault(int sig, siginfo_t *info, void *)
+{
+    uintptr_t addr = (uintptr_t)info->si_addr;
+    char buf[512];
+    size_t n = 0;
+    m61_region *region = m61_find_region((void *)addr);
+    if (region && region->sclass == M61_GUARDED && !m61_slot_live(region, 0))
+    {
+        m61_fault_puts(buf, &n, sizeof(buf), "MEMORY BUG: access to ");
+        m61_fault_putu(buf, &n, sizeof(buf), addr, 16);
+        m61_fault_puts(buf, &n, sizeof(buf), " inside freed block ");
+        m61_fault_putu(buf, &n, sizeof(buf), region->base + region->offset + m61_lead(), 16);
+        m61_fault_puts(buf, &n, sizeof(buf), "\n");
+    }
+    else if (region == nullptr
+             && (region = m61_find_region((void *)((addr & ~(M61_PAGE_SIZE - 1)) - 1)))
+             && region->sclass == M61_GUARDED && m61_slot_live(region, 0)
+             && addr - (region->base + region->length) < M61_PAGE_SIZE)
+    {
+        header *meta = (header *)(region->base + region->offset);
+        const char *file;
+        long line;
+        m61_site_location(meta->site, &file, &line);
+        m61_fault_puts(buf, &n, sizeof(buf), "MEMORY BUG: ");
+        m61_fault_puts(buf, &n, sizeof(buf), file);
+        m61_fault_puts(buf, &n, sizeof(buf), ":");
+        m61_fault_putu(buf, &n, sizeof(buf), line, 10);
+        m61_fault_puts(buf, &n, sizeof(buf), ": access to ");
+        m61_fault_putu(buf, &n, sizeof(buf), addr, 16);
+        m61_fault_puts(buf, &n, sizeof(buf), " is ");
+        m61_fault_putu(buf, &n, sizeof(buf), addr - ((uintptr_t)meta + m61_lead() + meta->size), 10);
+        m61_fault_puts(buf, &n, sizeof(buf), " bytes past the end of a ");
+        m61_fault_putu(buf, &n, sizeof(buf), meta->size, 10);
+        m61_fault_puts(buf, &n, sizeof(buf), " byte region allocated here\n");
+    }
+    if (n > 0)
+    {
+        ssize_t written = write(STDERR_FILENO, buf, n);
+        (void)written;
+    }
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+/// m61_guard_install()
+///    Install the guard mode SIGSEGV handler. It's one-shot: the next
+///    fault after it runs gets the default action. stdout is made line
+///    buffered, since the handler can't flush it before the process dies.
+static void m61_guard_install()
+{
+    fflush(stdout);
+    setvbuf(stdout, nullptr, _IOLBF, BUFSIZ);
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = m61_guard_fault;
+    action.sa_flags = SA_SIGINFO | SA_RESETHAND;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, nullptr);
+}
+
+static void m61_push_free(m61_class_state &cls, m61_free_slot *f)
+{
+    f->next = nullptr;
+    if (cls.free_tail)
+    {
+        cls.free_tail->next = f;
+    }
+    else
+    {
+        cls.free_head = f;
+    }
+    cls.free_tail = f;
+}
+
+/// m61_drain_remote(cache)
+///    Move every block other threads freed back to us onto our free lists.
+static void m61_drain_remote(m61_thread_cache *cache)
+{
+    m61_free_slot *f = cache->remote_frees.exchange(nullptr, std::memory_order_acquire);
+    while (f)
+    {
+        m61_free_slot *next = f->next;
+        m61_push_free(cache->classes[f->region->sclass], f);
+        f = next;
+    }
+}
+
+/// m61_slab_alloc(cache, sclass, region)
+///    Return a free slot of size class `sclass`, storing its chunk in
+///    `region`. Carves fresh slots before reusing freed ones. The caller
+///    marks it live once it's stamped.
+static header *m61_slab_alloc(m61_thread_cache *cache, unsigned sclass, m61_region *&region)
+{
+    m61_class_state &cls = cache->classes[sclass];
+    unsigned slot;
+    if (cls.carving && cls.carving->ncarved < cls.carving->nslots)
+    {
+        region = cls.carving;
+        slot = region->ncarved++;
+    }
+    else
+    {
+        if (cls.free_head == nullptr && cache->remote_frees.load(std::memory_order_relaxed))
+        {
+            m61_drain_remote(cache);
+        }
+        if (cls.free_head)
+        {
+            m61_free_slot *f = cls.free_head;
+            cls.free_head = f->next;
+            if (cls.free_head == nullptr)
+            {
+                cls.free_tail = nullptr;
+            }
+            region = f->region;
+            slot = m61_slot_of(region, (header *)((char *)f - m61_lead()));
+        }
+        else
+        {
+            //need a new chunk, at least 8 slots of the big classes
+            size_t slot_size = m61_slot_size(sclass);
+            unsigned nslots = std::max<size_t>(M61_CHUNK_SIZE / slot_size, 8);
+            region = m61_new_region(sclass, slot_size, nslots, cache,
+                                    m61_opts().cacheline ? M61_CACHE_LINE : 0);
+            if (region == nullptr)
+            {
+                return nullptr;
+            }
+            cls.carving = region;
+            slot = region->ncarved++;
+        }
+    }
+    return (header *)(region->base + region->offset + slot * region->slot_size);
+}
+
+/// m61_rear()
+///    Return how many '@' bytes follow a payload outside guard mode.
+static inline size_t m61_rear()
+{
+    return m61_opts().canary ? m61_opts().canary : M61_TRAILER;
+}
+
+/// m61_trailer_length(region, ptr, sz)
+///    Return how many '@' bytes follow the `sz` byte payload at `ptr` in
+///    `region`. Guard blocks fill the slack before their guard page, which
+///    is often nothing.
+static size_t m61_trailer_length(m61_region *region, void *ptr, size_t sz)
+{
+    if (region->sclass == M61_GUARDED)
+    {
+        return region->base + region->length - ((uintptr_t)ptr + sz);
+    }
+    return m61_rear();
+}
+
+/// m61_canary_ok(p, n)
+///    Return true if the `n` bytes at `p` are all '@'. With SSE2 it
+///    compares 16 bytes at a time and only branches once at the end.
+static bool m61_canary_ok(const char *p, size_t n)
+{
+    size_t i = 0;
+    bool ok = true;
+#if defined(__SSE2__)
+    if (n >= 16)
+    {
+        const __m128i want = _mm_set1_epi8('@');
+        __m128i same = _mm_set1_epi8(-1);
+        for (; i + 16 <= n; i += 16)
+        {
+            same = _mm_and_si128(same, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i)), want));
+        }
+        ok = _mm_movemask_epi8(same) == 0xFFFF;
+    }
+#endif
+    for (; i + 8 <= n; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, p + i, sizeof(word));
+        ok &= word == 0x4040404040404040ULL;
+    }
+    for (; i < n; ++i)
+    {
+        ok &= p[i] == '@';
+    }
+    return ok;
+}
+
+/// m61_block_intact(region, meta)
+///    Return true if active block `meta` in `region` has a good header and
+///    untouched canaries. The header is checked first since a bad one
+///    can't be trusted to say where the trailer is.
+static bool m61_block_intact(m61_region *region, header *meta)
+{
+    if (!m61_header_ok(meta, M61_ACTIVE))
+    {
+        return false;
+    }
+    size_t canary = m61_opts().canary;
+    char *ptr = (char *)meta + sizeof(header) + canary;
+    if (canary == 0 && region->sclass != M61_GUARDED)
+    {
+        return ptr[meta->size] == '@';
+    }
+    return m61_canary_ok(ptr - canary, canary)
+           && m61_canary_ok(ptr + meta->size, m61_trailer_length(region, ptr, meta->size));
+}
+
+/// m61_locate(addr, region, slot)
+///    Return the header of the slot `addr` falls in, storing its region
+///    and number in `region` and `slot`, or nullptr if `addr` isn't in a
+///    region. Lock free, it's one page map lookup.
+static header *m61_locate(uintptr_t addr, m61_region *&region, unsigned &slot)
+{
+    region = m61_find_region((void *)addr);
+    if (region == nullptr)
+    {
+        return nullptr;
+    }
+    //before the first slot is the slack of an offset region, the first
+    //slot's business. past the last is the rest of its last page
+    uintptr_t rel = addr - region->base;
+    slot = rel < region->offset ? 0 : (rel - region->offset) / region->slot_size;
+    if (slot >= region->nslots)
+    {
+        return nullptr;
+    }
+    return (header *)(region->base + region->offset + slot * region->slot_size);
+}
+
+/// m61_check_active(ptr, op, file, line, region)
+///    Validate that `ptr` is an active block being released by `op`
+///    ("free" or "realloc") and return its header, storing its region in
+///    `region`. Prints a MEMORY BUG report and returns nullptr if it is not.
+static header *m61_check_active(void *ptr, const char *op, const char *file, long line,
+                                m61_region *&region)
+{
+    //are we in el heap?
+    if ((uintptr_t)ptr < heap_min.load(std::memory_order_relaxed) || (uintptr_t)ptr > heap_max.load(std::memory_order_relaxed))
+    {
+        printf("MEMORY BUG: %s:%li: invalid %s of pointer %p, not in heap\n", file, line, op, ptr);
+        return nullptr;
+    }
+
+    //a zero byte guard block's pointer is the first byte of its guard
+    //page, so in guard mode go by the byte before it
+    uintptr_t addr = (uintptr_t)ptr - (m61_opts().guard ? 1 : 0);
+    header *ptr_to_meta = (header *)((char *)ptr - m61_lead());
+    unsigned slot;
+    if (header *slot_meta = m61_locate(addr, region, slot))
+    {
+        bool live = m61_slot_live(region, slot);
+        if (region->sclass == M61_GUARDED && !live)
+        {
+            //quarantined, its pages can't be read but it can only be one block
+            printf("MEMORY BUG: %s:%li: invalid %s of pointer %p, %s\n", file, line, op, ptr,
+                   slot_meta == ptr_to_meta ? "double free" : "not allocated");
+            return nullptr;
+        }
+        if (slot_meta == ptr_to_meta && live)
+        {
+            //taken from class answer at begining of last lecture thanks James?
+            if (!m61_block_intact(region, ptr_to_meta))
+            {
+                //we know our mem has been modified
+                printf("MEMORY BUG: %s:%li: detected wild write during %s of pointer %p\n", file, line, op, ptr);
+                return nullptr;
+            }
+            return ptr_to_meta;
+        }
+        if (slot_meta == ptr_to_meta && m61_header_ok(ptr_to_meta, M61_FREED))
+        {
+            printf("MEMORY BUG: %s:%li: invalid %s of pointer %p, double free\n", file, line, op, ptr);
+            return nullptr;
+        }
+        printf("MEMORY BUG: %s:%li: invalid %s of pointer %p, not allocated\n", file, line, op, ptr);
+        //check to see if ptr is trying to free inside another heap block
+        char *payload = (char *)slot_meta + m61_lead();
+        if (live && (char *)ptr >= payload && (char *)ptr < payload + slot_meta->size)
+        {
+            const char *alloc_file;
+            long alloc_line;
+            m61_site_location(slot_meta->site, &alloc_file, &alloc_line);
+            printf("  %s:%li: %p is %zu bytes inside a %zu byte region allocated here\n",
+                   alloc_file, alloc_line, ptr, (size_t)((char *)ptr - payload), slot_meta->size);
+        }
+        return nullptr;
+    }
+
+    //large blocks hand their region back on free, but the base allocator
+    //leaves freed metadata alone, and parked zero spans keep their first
+    //page, so we can still spot a double free. only look if the header's
+    //memory is still one of those, anything else in the heap's range may
+    //not even be mapped. not so in guard mode, where the pages might not
+    //be readable anymore
+    uintptr_t meta = (uintptr_t)ptr_to_meta;
+    if (!m61_opts().guard && ((uintptr_t)ptr & 7) == 0 && (uintptr_t)ptr >= m61_lead())
+    {
+        std::lock_guard<std::mutex> guard(region_lock);
+        bool ours = (base_contains((void *)meta) && base_contains((void *)(meta + sizeof(header) - 1)))
+                    || m61_parked(meta);
+        if (ours && m61_header_ok(ptr_to_meta, M61_FREED))
+        {
+            printf("MEMORY BUG: %s:%li: invalid %s of pointer %p, double free\n", file, line, op, ptr);
+            return nullptr;
+        }
+    }
+    printf("MEMORY BUG: %s:%li: invalid %s of pointer %p, not allocated\n", file, line, op, ptr);
+    return nullptr;
+}
+
+/// m61_zero(ptr, n)
+///    memset(ptr, 0, n), except that big runs are written with
+///    non-temporal stores so zeroing them doesn't flush the cache.
+static void m61_zero(void *ptr, size_t n)
+{
+#if defined(__SSE2__)
+    if (n >= M61_ZERO_STREAM)
+    {
+        char *p = (char *)ptr;
+        size_t head = -(uintptr_t)p & 15;
+        memset(p, 0, head);
+        p += head;
+        n -= head;
+        const __m128i zero = _mm_setzero_si128();
+        for (; n >= 64; p += 64, n -= 64)
+        {
+            _mm_stream_si128((__m128i *)p, zero);
+            _mm_stream_si128((__m128i *)(p + 16), zero);
+            _mm_stream_si128((__m128i *)(p + 32), zero);
+            _mm_stream_si128((__m128i *)(p + 48), zero);
+        }
+        //streaming stores aren't ordered, fence them before the block escapes
+        _mm_sfence();
+        memset(p, 0, n);
+        return;
+    }
+#endif
+    memset(ptr, 0, n);
+}
+
+/// m61_slab_align(sclass)
+///    Return the alignment every payload of size class `sclass` has.
+static size_t m61_slab_align(unsigned sclass)
+{
+    if (m61_opts().cacheline)
+    {
+        return M61_CACHE_LINE;
+    }
+    //regions start on a page, so it's down to the slot size and the lead
+    size_t slot_size = m61_slot_size(sclass), lead = m61_lead();
+    return std::min(slot_size & -slot_size, lead & -lead);
+}
+
+/// m61_alloc_block(cache, room, region, zeroed, align)
+///    Find a block with room for `room` payload bytes, storing its region
+///    in `region`. Doesn't touch the header or the stats. With `zeroed`, a
+///    large block comes from pages that read as zero. With `align`, the
+///    payload is `align` aligned.
+static header *m61_alloc_block(m61_thread_cache *cache, size_t room, m61_region *&region,
+                               bool zeroed, size_t align = 0)
+{
+    //a freed slot's link goes where the payload was, so there's always
+    //room for that past the front canary
+    size_t need = m61_opts().canary + std::max(room + m61_rear(), sizeof(m61_free_slot));
+    if (room >= M61_MAX_SIZE)
+    {
+        //way too big
+        return nullptr;
+    }
+    //small blocks come out of a slab, big ones get a region to themselves,
+    //padded out to whole pages so realloc can grow into the padding
+    if (need <= M61_MAX_SMALL)
+    {
+        //an alignment the class doesn't have might be had a class or two
+        //up, before the waste gets silly
+        unsigned sclass = m61_size_class(need);
+        while (sclass < M61_NCLASSES && m61_slab_align(sclass) < align && m61_class_size(sclass) < 2 * need + align)
+        {
+            ++sclass;
+        }
+        if (sclass < M61_NCLASSES && m61_slab_align(sclass) >= align)
+        {
+            return m61_slab_alloc(cache, sclass, region);
+        }
+    }
+    size_t span = (sizeof(header) + need + M61_PAGE_SIZE - 1) & ~(M61_PAGE_SIZE - 1);
+    if (zeroed)
+    {
+        region = m61_new_zeroed_region(span, cache);
+        return region ? (header *)region->base : nullptr;
+    }
+    region = m61_new_region(M61_NCLASSES, span, 1, cache,
+                            std::max<size_t>(align, m61_opts().cacheline ? M61_CACHE_LINE : 0));
+    if (region == nullptr)
+    {
+        return nullptr;
+    }
+    region->ncarved = 1;
+    return (header *)(region->base + region->offset);
+}
+
+//sampling mode: each thread runs a Poisson process over the bytes it
+//allocates, with a sample point every opts.sample bytes on average, and
+//only a block that one lands in gets its site recorded and counted as a
+//heavy hitter. a block of s bytes is sampled with probability
+//1 - e^(-s/sample), so each sampled one stands for s / that many bytes
+//and 1 / that many blocks. the rest keep their header check and canaries
+//but carry site 0
+
+/// m61_sample_gap(cache)
+///    Return an exponentially distributed number of bytes, averaging
+///    opts.sample, to the next sample point of `cache`.
+static long long m61_sample_gap(m61_thread_cache *cache)
+{
+    uint64_t x = cache->sample_rng ? cache->sample_rng : (uintptr_t)cache * 0x9E3779B97F4A7C15ULL | 1;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    cache->sample_rng = x;
+    //uniform in (0, 1]
+    double u = (double)(((x * 0x2545F4914F6CDD1DULL) >> 11) + 1) / (double)(1ULL << 53);
+    return (long long)(-std::log(u) * m61_opts().sample) + 1;
+}
+
+/// m61_sampled(cache, sz)
+///    Return true if the next `sz` bytes `cache` allocates hold a sample
+///    point. Always true outside sampling mode.
+static inline bool m61_sampled(m61_thread_cache *cache, size_t sz)
+{
+    if (m61_opts().sample == 0)
+    {
+        return true;
+    }
+    if (cache->sample_rng == 0)
+    {
+        cache->sample_left = m61_sample_gap(cache);
+    }
+    cache->sample_left -= sz;
+    if (cache->sample_left > 0)
+    {
+        return false;
+    }
+    cache->sample_left = m61_sample_gap(cache);
+    return true;
+}
+
+/// m61_sample_weight(sz)
+///    Return how many bytes a sampled block of `sz` bytes stands for.
+static double m61_sample_weight(size_t sz)
+{
+    size_t mean = m61_opts().sample;
+    if (mean == 0 || sz == 0)
+    {
+        return sz;
+    }
+    return sz / -std::expm1(-(double)sz / mean);
+}
+
+/// m61_hist_bucket(n)
+///    Return the log2 histogram bucket of `n`: its bit width, so bucket b
+///    holds [2^(b-1), 2^b) and bucket 0 holds 0.
+static inline unsigned m61_hist_bucket(unsigned long long n)
+{
+    return n ? std::min(64 - __builtin_clzll(n), M61_HIST_BUCKETS - 1) : 0;
+}
+
+/// m61_account(cache, region, slot, meta, sign)
+///    Count active block `meta`, `slot` of `region`, into (`sign` 1) or
+///    out of (`sign` -1) `cache`'s live counters by size class and by site
+///    and its histograms. Lifetimes are in allocation ticks of the region's
+///    owner, the only thread that allocates from it, so the owner's
+///    allocation count works as a clock no matter who frees.
+static inline void m61_account(m61_thread_cache *cache, m61_region *region, unsigned slot,
+                               const header *meta, int sign)
+{
+    uint32_t now = region->owner->stats.ntotal.load(std::memory_order_relaxed);
+    if (sign > 0)
+    {
+        m61_bump(cache->size_hist[m61_hist_bucket(meta->size)], 1);
+        region->born[slot] = now;
+        if (!region->stack.empty())
+        {
+            region->stack[slot] = current_stack;
+        }
+    }
+    else
+    {
+        m61_bump(cache->lifetime_hist[m61_hist_bucket((uint32_t)(now - region->born[slot]))], 1);
+    }
+    m61_bump(cache->class_blocks[region->sclass], sign);
+    m61_bump(cache->class_bytes[region->sclass], sign * (long long)meta->size);
+    if (meta->site)
+    {
+        long long bytes = m61_opts().sample ? (long long)m61_sample_weight(meta->size) : meta->size;
+        m61_bump(cache->site_bytes[meta->site < M61_STATS_SITES ? meta->site : 0], sign * bytes);
+    }
+}
+
+/// m61_write_block(region, meta, sz, site)
+///    Make `meta`, in `region`, describe an active `sz` byte block from
+///    allocation site `site`, and return its payload. Counts nothing.
+static void *m61_write_block(m61_region *region, header *meta, size_t sz, unsigned site)
+{
+    //pointer to return
+    //the actual requested data
+    void *ptr = (void *)((char *)meta + m61_lead());
+
+    //trailer help
+    //this is the ptr to requested data + the size that
+    //gets us to the end of the total allocation to add.
+    //canaries go down before the header so a heap check never sees a new
+    //header with old canaries
+    char *ptr_to_trailer = (char *)ptr + sz;
+    size_t canary = m61_opts().canary;
+    if (canary == 0 && region->sclass != M61_GUARDED)
+    {
+        *ptr_to_trailer = '@';
+    }
+    else
+    {
+        memset(ptr_to_trailer, '@', m61_trailer_length(region, ptr, sz));
+        memset((char *)ptr - canary, '@', canary);
+    }
+
+    meta->size = sz;           //originial requested size to be used by free
+    meta->state = M61_ACTIVE;  //this data is currently malloced
+    //updates for leak report
+    meta->site = site;
+    meta->check = m61_header_check(meta);
+
+    //heap min and max testing
+    m61_note_extent((uintptr_t)ptr, (uintptr_t)ptr + sz);
+    return ptr;
+}
+
+/// m61_stamp_block(cache, region, meta, sz, file, line)
+///    Make `meta`, in `region`, describe an active `sz` byte block
+///    allocated at `file`:`line` and count the allocation. The caller
+///    accounts for the change in active blocks and bytes.
+static void *m61_stamp_block(m61_thread_cache *cache, m61_region *region, header *meta, size_t sz,
+                             const char *file, long line)
+{
+    bool sampled = m61_sampled(cache, sz);
+    void *ptr = m61_write_block(region, meta, sz, sampled ? m61_site_id(file, line) : 0);
+
+    //update stats on sucess
+    m61_bump(cache->stats.ntotal, 1);       //number of total allocations
+    m61_bump(cache->stats.total_size, sz);  //total number of bytes in successful allocs
+    //update for heavy hitters report, scaled up when we're sampling
+    if (sampled)
+    {
+        m61_hh_add(cache->heavy_hitters, meta->site, m61_opts().sample ? (size_t)m61_sample_weight(sz) : sz);
+    }
+    return ptr;
+}
+
+/// m61_allocate(sz, room, file, line, zero, align)
+///    m61_malloc, but the block has room for at least `room` >= `sz` bytes,
+///    with `zero` its payload is zeroed and with `align` it's `align`
+///    aligned.
+static void *m61_allocate(size_t sz, size_t room, const char *file, long line, bool zero = false,
+                          size_t align = 0)
+{
+    m61_thread_cache *cache = m61_get_cache();
+    m61_region *region = nullptr;
+    header *ptr_to_allocation = m61_opts().guard ? m61_guard_alloc(cache, sz, region, align)
+                                                 : m61_alloc_block(cache, room, region,
+                                                                   zero && sz >= M61_ZERO_MAP, align);
+    if (ptr_to_allocation == nullptr)
+    {
+        //fail and update stats accordingly
+        m61_bump(cache->stats.nfail, 1);          //number of total failed allocs
+        m61_bump(cache->stats.fail_size, sz);     //running total of failed alloc request size in bytes
+        return nullptr;
+    }
+    void *ptr = m61_stamp_block(cache, region, ptr_to_allocation, sz, file, line);
+    //guard runs are fresh arena pages or had theirs dropped, so like
+    //zero_spans they read as zero already
+    if (zero && !region->mapped && region->sclass != M61_GUARDED)
+    {
+        m61_zero(ptr, sz);
+    }
+    unsigned slot = m61_slot_of(region, ptr_to_allocation);
+    m61_account(cache, region, slot, ptr_to_allocation, 1);
+    //live only once it's stamped, so a heap check doesn't look too early
+    m61_set_live(region, slot);
+    m61_bump(cache->stats.nactive, 1);      //num of active allocs
+    m61_bump(cache->stats.active_size, sz); //active minus freed allocation sizes in bytes
+    return ptr;
 }
 
 /// m61_malloc(sz, file, line)
@@ -26,292 +1813,1259 @@ bool cus_cmp(const heavy_hitters_item &x, const heavy_hitters_item &y)
 ///    return a unique, newly-allocated pointer value. The allocation
 ///    request was at location `file`:`line`.
 void *m61_malloc(size_t sz, const char *file, long line)
+{
+    m61_note_stack();
+    void *ptr = m61_allocate(sz, sz, file, line);
+    if (m61_trace_header *trace = m61_opts().trace)
+    {
+        m61_trace_fill(m61_trace_claim(trace), M61_TRACE_MALLOC, ptr, nullptr, sz, file, line);
+    }
+    return ptr;
+}
+
+/// m61_good_size(sz)
+///    Return how many bytes the block m61_malloc(sz) would get has room
+///    for, at least `sz`.
+static size_t m61_good_size(size_t sz)
+{
+    if (m61_opts().guard || sz >= M61_MAX_SIZE)
+    {
+        return sz;
+    }
+    //m61_alloc_block's arithmetic, backwards
+    size_t need = m61_opts().canary + std::max(sz + m61_rear(), sizeof(m61_free_slot));
+    size_t slot_size = need <= M61_MAX_SMALL
+                           ? m61_slot_size(m61_size_class(need))
+                           : (sizeof(header) + need + M61_PAGE_SIZE - 1) & ~(M61_PAGE_SIZE - 1);
+    return slot_size - m61_lead() - m61_rear();
+}
+
+/// m61_malloc_at_least(sz, room, file, line)
+///    Return a pointer to at least `sz` bytes of newly-allocated dynamic
+///    memory, storing how many in `*room`: the whole of the block, so
+///    growing into it later is free. The allocation request was at
+///    location `file`:`line`.
+void *m61_malloc_at_least(size_t sz, size_t *room, const char *file, long line)
+{
+    m61_note_stack();
+    size_t good = m61_good_size(sz);
+    void *ptr = m61_allocate(good, good, file, line);
+    if (m61_trace_header *trace = m61_opts().trace)
+    {
+        m61_trace_fill(m61_trace_claim(trace), M61_TRACE_MALLOC, ptr, nullptr, good, file, line);
+    }
+    *room = ptr ? good : 0;
+    return ptr;
+}
+
+/// m61_aligned(align, sz, file, line)
+///    m61_aligned_alloc, without the tracing.
+static void *m61_aligned(size_t align, size_t sz, const char *file, long line)
+{
+    if (align == 0 || (align & (align - 1)) != 0 || align >= M61_MAX_SIZE)
+    {
+        m61_thread_cache *cache = m61_get_cache();
+        m61_bump(cache->stats.nfail, 1);
+        m61_bump(cache->stats.fail_size, sz);
+        return nullptr;
+    }
+    return m61_allocate(sz, sz, file, line, false, align);
+}
+
+/// m61_aligned_alloc(align, sz, file, line)
+///    Return a pointer to `sz` bytes of newly-allocated dynamic memory
+///    aligned to `align`, a power of two, or nullptr if it isn't one. The
+///    allocation request was at location `file`:`line`.
+void *m61_aligned_alloc(size_t align, size_t sz, const char *file, long line)
+{
+    m61_note_stack();
+    void *ptr = m61_aligned(align, sz, file, line);
+    if (m61_trace_header *trace = m61_opts().trace)
+    {
+        m61_trace_fill(m61_trace_claim(trace), M61_TRACE_MALLOC, ptr, nullptr, sz, file, line);
+    }
+    return ptr;
+}
+
+/// m61_memalign(align, sz, file, line)
+///    The old name for m61_aligned_alloc.
+void *m61_memalign(size_t align, size_t sz, const char *file, long line)
+{
+    m61_note_stack();
+    void *ptr = m61_aligned(align, sz, file, line);
+    if (m61_trace_header *trace = m61_opts().trace)
+    {
+        m61_trace_fill(m61_trace_claim(trace), M61_TRACE_MALLOC, ptr, nullptr, sz, file, line);
+    }
+    return ptr;
+}
+
+/// m61_recycle(cache, region, meta, ptr)
+///    Mark block `meta`, with payload `ptr`, freed and hand it back to
+///    `region`. Its live bit is already clear.
+static void m61_recycle(m61_thread_cache *cache, m61_region *region, header *meta, void *ptr)
+{
+    meta->state = M61_FREED;
+    meta->check = m61_header_check(meta);
+
+    if (region->sclass == M61_GUARDED)
+    {
+        m61_guard_release(region);
+        return;
+    }
+    if (region->sclass == M61_NCLASSES)
+    {
+        //large block, give the whole region back
+        m61_release_region(region);
+        return;
+    }
+    m61_free_slot *f = (m61_free_slot *)ptr;
+    f->region = region;
+    m61_thread_cache *owner = region->owner;
+    if (owner == cache)
+    {
+        //back of the line for its size class
+        m61_push_free(cache->classes[region->sclass], f);
+        return;
+    }
+    //somebody else's slab, send it home
+    f->next = owner->remote_frees.load(std::memory_order_relaxed);
+    while (!owner->remote_frees.compare_exchange_weak(f->next, f, std::memory_order_release,
+                                                      std::memory_order_relaxed))
+    {
+    }
+}
+
+/// m61_release(ptr, file, line)
+///    m61_free, without the tracing.
+static void m61_release(void *ptr, const char *file, long line)
 {
     (void)file, (void)line; // avoid uninitialized variable warnings
     // Your code here.
+    //null pointers are freeable
+    if (ptr == nullptr)
+    {
+        return;
+    }
+
+    m61_region *region = nullptr;
+    header *ptr_to_meta = m61_check_active(ptr, "free", file, line, region);
+    if (ptr_to_meta == nullptr)
+    {
+        return;
+    }
+    unsigned slot = m61_slot_of(region, ptr_to_meta);
+    if (!m61_clear_live(region, slot))
+    {
+        //someone else freed it between our check and now
+        printf("MEMORY BUG: %s:%li: invalid free of pointer %p, double free\n", file, line, ptr);
+        return;
+    }
+
+    //stat updoots, a block freed by another thread just makes that
+    //thread's counters go negative, the sums still come out right
+    m61_thread_cache *cache = m61_get_cache();
+    m61_bump(cache->stats.nactive, -1);
+    m61_bump(cache->stats.active_size, -ptr_to_meta->size);
+    m61_account(cache, region, slot, ptr_to_meta, -1);
+    m61_recycle(cache, region, ptr_to_meta, ptr);
+}
+
+/// m61_free(ptr, file, line)
+///    Free the memory space pointed to by `ptr`, which must have been
+///    returned by a previous call to m61_malloc. If `ptr == NULL`,
+///    does nothing. The free was called at location `file`:`line`.
+
+void m61_free(void *ptr, const char *file, long line)
+{
+    m61_trace_header *trace = m61_opts().trace;
+    if (trace && ptr)
+    {
+        m61_trace_fill(m61_trace_claim(trace), M61_TRACE_FREE, ptr, nullptr, 0, file, line);
+    }
+    m61_release(ptr, file, line);
+}
+
+/// m61_describe(ptr, info, site)
+///    m61_block_info, looking up the allocation site only if `site`.
+static bool m61_describe(const void *ptr, m61_block *info, bool site)
+{
+    uintptr_t addr = (uintptr_t)ptr;
+    //guard mode has to keep the block's pages from going PROT_NONE while
+    //we read its header
+    std::unique_lock<std::mutex> guard(guard_lock, std::defer_lock);
+    if (m61_opts().guard)
+    {
+        guard.lock();
+    }
+    m61_region *region;
+    unsigned slot;
+    header *meta = m61_locate(addr, region, slot);
+    if (meta == nullptr && m61_opts().guard)
+    {
+        //a zero byte guard block's pointer is the first byte of its guard page
+        meta = m61_locate(addr - 1, region, slot);
+        if (meta && addr != (uintptr_t)meta + m61_lead())
+        {
+            return false;
+        }
+    }
+    if (meta == nullptr || addr < (uintptr_t)meta)
+    {
+        //not ours, or the slack before a guard block
+        return false;
+    }
+    info->base = (char *)meta + m61_lead();
+    info->size = 0;
+    info->file = "?";
+    info->line = 0;
+    info->state = 0;
+    if (m61_slot_live(region, slot))
+    {
+        info->state = M61_ACTIVE;
+    }
+    else if (region->sclass == M61_GUARDED)
+    {
+        //quarantined, its pages can't be read
+        info->state = M61_FREED;
+        return true;
+    }
+    else if (m61_header_ok(meta, M61_FREED))
+    {
+        info->state = M61_FREED;
+    }
+    else
+    {
+        //never handed out
+        return true;
+    }
+    info->size = meta->size;
+    if (site)
+    {
+        m61_site_location(meta->site, &info->file, &info->line);
+    }
+    return true;
+}
+
+/// m61_block_info(ptr, info)
+///    If `ptr` is anywhere in one of our blocks, header and canaries
+///    included, describe the block in `*info` and return true. One page
+///    map lookup, no locks outside guard mode.
+bool m61_block_info(const void *ptr, m61_block *info)
+{
+    return m61_describe(ptr, info, true);
+}
+
+/// m61_owns(ptr)
+///    Return true if `ptr` points into the payload of an active block (or
+///    at a zero byte one).
+bool m61_owns(const void *ptr)
+{
+    m61_block info;
+    return (uintptr_t)ptr >= heap_min.load(std::memory_order_relaxed)
+           && (uintptr_t)ptr <= heap_max.load(std::memory_order_relaxed)
+           && m61_describe(ptr, &info, false) && info.state == M61_ACTIVE
+           && (char *)ptr >= (char *)info.base
+           && (char *)ptr < (char *)info.base + std::max<size_t>(info.size, 1);
+}
+
+/// m61_malloc_batch(n, sz, out, file, line)
+///    Allocate `n` blocks of `sz` bytes into `out`, as if by `n` calls to
+///    m61_malloc, and return how many there are: fewer than `n` only if
+///    one failed. Small blocks come straight off the size class, with the
+///    statistics updated once for the lot.
+size_t m61_malloc_batch(size_t n, size_t sz, void **out, const char *file, long line)
+{
+    m61_note_stack();
+    m61_thread_cache *cache = m61_get_cache();
+    const m61_options &opts = m61_opts();
+    size_t need = opts.canary + std::max(sz + m61_rear(), sizeof(m61_free_slot));
+    size_t i = 0;
+    if (opts.guard || sz >= M61_MAX_SIZE || need > M61_MAX_SMALL)
+    {
+        //guard and large blocks are a syscall apiece anyway
+        for (; i != n && (out[i] = m61_allocate(sz, sz, file, line)); ++i)
+        {
+        }
+    }
+    else
+    {
+        unsigned sclass = m61_size_class(need);
+        unsigned site = m61_site_id(file, line);
+        //m61_account's clock, as it will read once we've counted the lot
+        uint32_t now = cache->stats.ntotal.load(std::memory_order_relaxed);
+        size_t nsampled = 0;
+        for (; i != n; ++i)
+        {
+            m61_region *region;
+            header *meta = m61_slab_alloc(cache, sclass, region);
+            if (meta == nullptr)
+            {
+                break;
+            }
+            bool sampled = m61_sampled(cache, sz);
+            nsampled += sampled;
+            out[i] = m61_write_block(region, meta, sz, sampled ? site : 0);
+            unsigned slot = m61_slot_of(region, meta);
+            region->born[slot] = now + i + 1;
+            if (!region->stack.empty())
+            {
+                region->stack[slot] = current_stack;
+            }
+            m61_set_live(region, slot);
+        }
+        m61_bump(cache->stats.ntotal, i);
+        m61_bump(cache->stats.total_size, i * sz);
+        m61_bump(cache->stats.nactive, i);
+        m61_bump(cache->stats.active_size, i * sz);
+        m61_bump(cache->size_hist[m61_hist_bucket(sz)], i);
+        m61_bump(cache->class_blocks[sclass], i);
+        m61_bump(cache->class_bytes[sclass], i * sz);
+        if (nsampled)
+        {
+            size_t bytes = nsampled * (opts.sample ? (size_t)m61_sample_weight(sz) : sz);
+            m61_bump(cache->site_bytes[site < M61_STATS_SITES ? site : 0], bytes);
+            m61_hh_add(cache->heavy_hitters, site, bytes);
+        }
+        //m61_allocate counts its own failures on the other path
+        if (i != n)
+        {
+            m61_bump(cache->stats.nfail, 1);
+            m61_bump(cache->stats.fail_size, sz);
+        }
+    }
+    if (m61_trace_header *trace = opts.trace)
+    {
+        for (size_t j = 0; j != std::min(i + 1, n); ++j)
+        {
+            m61_trace_fill(m61_trace_claim(trace), M61_TRACE_MALLOC, j < i ? out[j] : nullptr, nullptr, sz,
+                           file, line);
+        }
+    }
+    return i;
+}
+
+//how far ahead m61_free_batch loads headers
+#define M61_PREFETCH_AHEAD 8
+
+/// m61_free_batch(ptrs, n, file, line)
+///    Free the `n` blocks in `ptrs`, as if by `n` calls to m61_free.
+///    Headers are prefetched a few blocks ahead of the one being checked,
+///    and freed slab blocks of ours are spliced onto their size class's
+///    free list a class at a time.
+void m61_free_batch(void **ptrs, size_t n, const char *file, long line)
+{
+    m61_thread_cache *cache = m61_get_cache();
+    m61_trace_header *trace = m61_opts().trace;
+    size_t lead = m61_lead();
+    m61_free_slot *head[M61_NCLASSES] = {}, *tail[M61_NCLASSES] = {};
+    unsigned long long nfreed = 0, bytes = 0;
+    for (size_t i = 0; i != std::min<size_t>(n, M61_PREFETCH_AHEAD); ++i)
+    {
+        __builtin_prefetch((char *)ptrs[i] - lead, 1);
+    }
+    for (size_t i = 0; i != n; ++i)
+    {
+        if (i + M61_PREFETCH_AHEAD < n)
+        {
+            __builtin_prefetch((char *)ptrs[i + M61_PREFETCH_AHEAD] - lead, 1);
+        }
+        void *ptr = ptrs[i];
+        if (ptr == nullptr)
+        {
+            continue;
+        }
+        if (trace)
+        {
+            m61_trace_fill(m61_trace_claim(trace), M61_TRACE_FREE, ptr, nullptr, 0, file, line);
+        }
+        m61_region *region = nullptr;
+        header *meta = m61_check_active(ptr, "free", file, line, region);
+        if (meta == nullptr)
+        {
+            continue;
+        }
+        unsigned slot = m61_slot_of(region, meta);
+        if (!m61_clear_live(region, slot))
+        {
+            printf("MEMORY BUG: %s:%li: invalid free of pointer %p, double free\n", file, line, ptr);
+            continue;
+        }
+        ++nfreed;
+        bytes += meta->size;
+        m61_account(cache, region, slot, meta, -1);
+        if (region->owner != cache || region->sclass >= M61_NCLASSES)
+        {
+            m61_recycle(cache, region, meta, ptr);
+            continue;
+        }
+        //m61_recycle for our own slab blocks, but chained up locally
+        meta->state = M61_FREED;
+        meta->check = m61_header_check(meta);
+        m61_free_slot *f = (m61_free_slot *)ptr;
+        f->region = region;
+        f->next = nullptr;
+        unsigned sclass = region->sclass;
+        (tail[sclass] ? tail[sclass]->next : head[sclass]) = f;
+        tail[sclass] = f;
+    }
+    for (unsigned sclass = 0; sclass != M61_NCLASSES; ++sclass)
+    {
+        if (head[sclass] == nullptr)
+        {
+            continue;
+        }
+        m61_class_state &cls = cache->classes[sclass];
+        (cls.free_tail ? cls.free_tail->next : cls.free_head) = head[sclass];
+        cls.free_tail = tail[sclass];
+    }
+    m61_bump(cache->stats.nactive, -nfreed);
+    m61_bump(cache->stats.active_size, -bytes);
+}
+
+/// m61_calloc(nmemb, sz, file, line)
+///    Return a pointer to newly-allocated dynamic memory big enough to
+///    hold an array of `nmemb` elements of `sz` bytes each. If `sz == 0`,
+///    then must return a unique, newly-allocated pointer value. Returned
+///    memory should be initialized to zero. The allocation request was at
+///    location `file`:`line`.
+
+void *m61_calloc(size_t nmemb, size_t sz, const char *file, long line)
+{
+    // Your code here (to fix test014).
+    m61_note_stack();
+    void *ptr = nullptr;
+    if (nmemb != 0 && (nmemb * sz / nmemb) != sz)
+    {
+        m61_bump(m61_get_cache()->stats.nfail, 1);
+    }
+    else
+    {
+        //big ones come straight from zeroed pages, only touched as used
+        ptr = m61_allocate(nmemb * sz, nmemb * sz, file, line, true);
+    }
+    if (m61_trace_header *trace = m61_opts().trace)
+    {
+        m61_trace_fill(m61_trace_claim(trace), M61_TRACE_CALLOC, ptr, nullptr, nmemb * sz, file, line);
+    }
+    return ptr;
+}
+
+/// m61_reallocate(ptr, sz, file, line)
+///    m61_realloc, without the tracing.
+static void *m61_reallocate(void *ptr, size_t sz, const char *file, long line)
+{
+    if (ptr == nullptr)
+    {
+        void *ptr_to_return = m61_allocate(sz, sz, file, line);
+        return ptr_to_return;
+    }
+    if (sz == 0)
+    {
+        m61_release(ptr, file, line);
+        return ptr;
+    }
+    //make sure we own ptr before touching it
+    m61_region *region = nullptr;
+    header *ptr_to_meta = m61_check_active(ptr, "realloc", file, line, region);
+    if (ptr_to_meta == nullptr)
+    {
+        return nullptr;
+    }
+    //recover original size from our metadata
+    size_t original_size = ptr_to_meta->size;
+    size_t room = region->slot_size - m61_lead() - m61_rear();
+    bool large = region->sclass == M61_NCLASSES;
+    //if the slot has room just move the trailer, it counts as a new
+    //allocation of sz bytes like the copy would. a big block that shrinks
+    //below half its room moves so we don't sit on the rest. guard blocks
+    //always move so the new end is up against a guard page
+    if (region->sclass != M61_GUARDED && sz <= room && !(large && sz < room / 2))
+    {
+        m61_thread_cache *cache = m61_get_cache();
+        //not live while the header is half written, so a heap check skips it
+        unsigned slot = m61_slot_of(region, ptr_to_meta);
+        m61_clear_live(region, slot);
+        m61_account(cache, region, slot, ptr_to_meta, -1);
+        m61_stamp_block(cache, region, ptr_to_meta, sz, file, line);
+        m61_account(cache, region, slot, ptr_to_meta, 1);
+        m61_set_live(region, slot);
+        m61_bump(cache->stats.active_size, sz - original_size);
+        return ptr;
+    }
+    //request new memory of size sz. big blocks get a quarter extra so
+    //growing a buffer a little at a time doesn't copy every time
+    size_t reserve = sz + M61_TRAILER > M61_MAX_SMALL ? sz + sz / 4 : sz;
+    void *ptr_to_new_mem = m61_allocate(sz, reserve, file, line);
+    if (ptr_to_new_mem == nullptr)
+    {
+        return nullptr;
+    }
+    //copy original stuff to new allocation
+    std::memcpy(ptr_to_new_mem, ptr, std::min(original_size, sz));
+
+    //free orig memory
+    m61_release(ptr, file, line);
+    return ptr_to_new_mem;
+}
+
+/// m61_realloc(ptr, sz, file, line)
+///    Reallocate the dynamic memory pointed to by `ptr` to hold at least
+///    `sz` bytes, returning a pointer to the new block. If `ptr` is
+///    `nullptr`, behaves like `m61_malloc(sz, file, line)`. If `sz` is 0,
+///    behaves like `m61_free(ptr, file, line)`. The allocation request
+///    was at location `file`:`line`.
+
+void *m61_realloc(void *ptr, size_t sz, const char *file, long line)
+{
+    m61_note_stack();
+    m61_trace_header *trace = m61_opts().trace;
+    m61_trace_event *event = trace ? m61_trace_claim(trace) : nullptr;
+    void *ptr_to_return = m61_reallocate(ptr, sz, file, line);
+    if (event)
+    {
+        m61_trace_fill(event, M61_TRACE_REALLOC, sz ? ptr_to_return : nullptr, ptr, sz, file, line);
+    }
+    return ptr_to_return;
+}
+
+//arenas: objects are bump allocated from chunks and all freed at once.
+//chunks are ordinary blocks stamped with the arena's creation site, but
+//left out of the statistics, which count the objects instead. a chunk's
+//payload starts with an m61_arena_chunk, so no object sits where a block
+//starts and freeing one is caught as an invalid free. an arena is used by
+//one thread at a time
+#define M61_ARENA_CHUNK ((size_t)64 << 10)
+#define M61_ARENA_MAX_CHUNK ((size_t)1 << 20)
+#define M61_ARENA_ALIGN 16
+
+struct m61_arena_chunk
+{
+    m61_arena_chunk *next;
+    m61_arena *arena;
+    uint64_t tag;                 //m61_arena_tag(this), tells chunks from other blocks
+};
+
+struct m61_arena
+{
+    m61_arena_chunk *chunks;      //the one we bump in first, then the rest
+    uintptr_t next;               //bump pointer
+    uintptr_t end;
+    size_t chunk_size;            //object room in the next chunk, doubling up to M61_ARENA_MAX_CHUNK
+    unsigned site;                //where the arena was created
+    unsigned long long nobjects;  //objects allocated
+    unsigned long long bytes;     //bytes in them
+    unsigned long long unreported; //bytes the heavy hitter sketch hasn't been told about
+};
+
+static uint64_t m61_arena_tag(const m61_arena_chunk *chunk)
+{
+    return ((uintptr_t)chunk * 0x9E3779B97F4A7C15ULL) ^ 0xA7E4A7E4A7E4A7E4ULL;
+}
 
-    //check to make sure size isn't too big
-    //taken from the test verbatim not sure about that feels yucky but works
-    if (sz >= ((size_t)-1 - 150))
+/// m61_arena_of(meta)
+///    Return the arena whose chunk active block `meta` is, or nullptr.
+static m61_arena *m61_arena_of(const header *meta)
+{
+    const m61_arena_chunk *chunk = (const m61_arena_chunk *)((const char *)meta + m61_lead());
+    if (meta->size < sizeof(m61_arena_chunk) || chunk->tag != m61_arena_tag(chunk))
     {
-        //if it is fail and update stats accordingly
-        global_stats.nfail++;         //number of total failed allocs
-        global_stats.fail_size += sz; //running total of failed alloc request size in bytes
         return nullptr;
     }
+    return chunk->arena;
+}
 
-    //actual amount to return
-    size_t rounded_sz = (sz + sizeof(header) + sizeof(size_t) + 8);
-
-    struct header metadata = {};
-    metadata.size = sz;        //originial requested size to be used by free
-    metadata.is_active = 1337; //this data is currently malloced
-    metadata.metadata_id = MAGIC_META_ID;
-    //updates for leak report
-    metadata.file = file;
-    metadata.line = line;
-
-    //create and store info for heavey hitters report
-    heavy_hitters_item hitter_item = {};
-    hitter_item.file = file;
-    hitter_item.line = line;
-    hitter_item.size = sz;
+/// m61_arena_objects(chunk)
+///    Return where `chunk`'s objects start: right after it, rounded up to
+///    M61_ARENA_ALIGN, since the canary only keeps payloads 8 byte aligned.
+static uintptr_t m61_arena_objects(m61_arena_chunk *chunk)
+{
+    return ((uintptr_t)(chunk + 1) + M61_ARENA_ALIGN - 1) & ~(uintptr_t)(M61_ARENA_ALIGN - 1);
+}
 
-    //this inculdes meta + payload (user requested sz)
-    header *ptr_to_allocation = (header *)base_malloc(rounded_sz);
-    *ptr_to_allocation = metadata;
-    //attach to the list
-    ptr_to_allocation->ptr_to_next = global_base.ptr_to_next;
-    ptr_to_allocation->ptr_to_last = &global_base;
-    //circle the list around
-    if (global_base.ptr_to_next != nullptr)
+/// m61_arena_grow(arena, room)
+///    Allocate a chunk with `room` bytes for objects to `arena`, or
+///    return nullptr. The caller links it in.
+static m61_arena_chunk *m61_arena_grow(m61_arena *arena, size_t room)
+{
+    m61_thread_cache *cache = m61_get_cache();
+    m61_region *region = nullptr;
+    size_t sz = sizeof(m61_arena_chunk) + M61_ARENA_ALIGN - 1 + room;
+    header *meta = m61_opts().guard ? m61_guard_alloc(cache, sz, region)
+                                    : m61_alloc_block(cache, sz, region, false);
+    if (meta == nullptr)
     {
-        global_base.ptr_to_next->ptr_to_last = ptr_to_allocation;
+        return nullptr;
     }
-    global_base.ptr_to_next = ptr_to_allocation;
-
-    //pointer to return
-    //the actual requested data
-    void *ptr = (void *)((char *)ptr_to_allocation + sizeof(header));
+    m61_arena_chunk *chunk = (m61_arena_chunk *)m61_write_block(region, meta, sz, arena->site);
+    chunk->next = nullptr;
+    chunk->arena = arena;
+    chunk->tag = m61_arena_tag(chunk);
+    m61_set_live(region, m61_slot_of(region, meta));
+    //a new chunk is a good time to tell the sketch what we've been up to
+    if (arena->unreported)
+    {
+        m61_hh_add(cache->heavy_hitters, arena->site, arena->unreported);
+        arena->unreported = 0;
+    }
+    return chunk;
+}
 
-    //trailer help
-    //this is the ptr to requested data + the size that
-    //gets us to the end of the total allocation to add
-    char *ptr_to_trailer = (char *)ptr + sz;
-    *ptr_to_trailer = '@';
+/// m61_arena_create(file, line)
+///    Return a new, empty arena, whose objects are accounted to
+///    `file`:`line`.
+m61_arena *m61_arena_create(const char *file, long line)
+{
+    m61_arena *arena = new m61_arena();
+    arena->chunk_size = M61_ARENA_CHUNK;
+    arena->site = m61_site_id(file, line);
+    return arena;
+}
 
-    //heap min and max testing
-    if (global_stats.heap_min == 0)
+/// m61_arena_alloc(arena, sz)
+///    Return `sz` bytes from `arena`, 16 byte aligned. They can't be
+///    freed on their own.
+void *m61_arena_alloc(m61_arena *arena, size_t sz)
+{
+    m61_thread_cache *cache = m61_get_cache();
+    if (sz >= M61_MAX_SIZE)
     {
-        global_stats.heap_min = (uintptr_t)ptr;
+        m61_bump(cache->stats.nfail, 1);
+        m61_bump(cache->stats.fail_size, sz);
+        return nullptr;
     }
-    if (global_stats.heap_max <= (uintptr_t)ptr)
+    //zero byte objects still get a byte so they're all different
+    size_t need = (std::max<size_t>(sz, 1) + M61_ARENA_ALIGN - 1) & ~(M61_ARENA_ALIGN - 1);
+    uintptr_t ptr = arena->next;
+    if (need <= arena->end - ptr)
     {
-        global_stats.heap_max = (uintptr_t)ptr + sz;
+        arena->next = ptr + need;
     }
-
-    if (global_stats.heap_min > (uintptr_t)ptr)
+    else
     {
-        global_stats.heap_min = (uintptr_t)ptr;
+        //big objects get a chunk to themselves, behind the one we bump in
+        bool alone = need > arena->chunk_size / 4;
+        m61_arena_chunk *chunk = m61_arena_grow(arena, alone ? need : arena->chunk_size);
+        if (chunk == nullptr)
+        {
+            m61_bump(cache->stats.nfail, 1);
+            m61_bump(cache->stats.fail_size, sz);
+            return nullptr;
+        }
+        ptr = m61_arena_objects(chunk);
+        if (alone && arena->chunks)
+        {
+            chunk->next = arena->chunks->next;
+            arena->chunks->next = chunk;
+        }
+        else
+        {
+            chunk->next = arena->chunks;
+            arena->chunks = chunk;
+            arena->next = ptr + need;
+            arena->end = ptr + (alone ? need : arena->chunk_size);
+            arena->chunk_size = std::min(arena->chunk_size * 2, M61_ARENA_MAX_CHUNK);
+        }
     }
 
-    //update stats on sucess
-    global_stats.ntotal++;          //number of total allocations
-    global_stats.total_size += sz;  //total number of bytes in successful allocs
-    global_stats.nactive++;         //num of active allocs
-    global_stats.active_size += sz; //active minus freed allocation sizes in bytes
-    //update for heavy hitters report
-    heavy_hitters_report_vector.push_back(hitter_item);
-    return ptr;
+    m61_bump(cache->stats.ntotal, 1);
+    m61_bump(cache->stats.total_size, sz);
+    m61_bump(cache->stats.nactive, 1);
+    m61_bump(cache->stats.active_size, sz);
+    m61_bump(cache->size_hist[m61_hist_bucket(sz)], 1);
+    m61_bump(cache->site_bytes[arena->site < M61_STATS_SITES ? arena->site : 0], sz);
+    ++arena->nobjects;
+    arena->bytes += sz;
+    arena->unreported += sz;
+    return (void *)ptr;
 }
 
-/// m61_free(ptr, file, line)
-///    Free the memory space pointed to by `ptr`, which must have been
-///    returned by a previous call to m61_malloc. If `ptr == NULL`,
-///    does nothing. The free was called at location `file`:`line`.
-
-void m61_free(void *ptr, const char *file, long line)
+/// m61_arena_destroy(arena, file, line)
+///    Free every object of `arena`, and the arena. The destroy was called
+///    at location `file`:`line`.
+void m61_arena_destroy(m61_arena *arena, const char *file, long line)
 {
-    (void)file, (void)line; // avoid uninitialized variable warnings
-    // Your code here.
-    //null pointers are freeable
-    if (ptr == nullptr)
+    if (arena == nullptr)
     {
         return;
     }
-
-    //are we in el heap?
-    if ((uintptr_t)ptr < global_stats.heap_min || (uintptr_t)ptr > global_stats.heap_max)
+    m61_thread_cache *cache = m61_get_cache();
+    if (arena->unreported)
     {
-        printf("MEMORY BUG %s:%li: invalid free of pointer %p, not in heap\n", file, line, ptr);
-        return;
+        m61_hh_add(cache->heavy_hitters, arena->site, arena->unreported);
     }
-    //need to subtract struct to get to metadata
-    header *ptr_to_meta = (header *)((char *)ptr - sizeof(header));
-
-    //bitwise AND operation (0000 0000 0000 0111) checking to see if our ptr address is div by 8
-    //if not then we know we're dealing with an unallocated call
-    if ((((uintptr_t)ptr & 7) != 0) || (ptr_to_meta->metadata_id != MAGIC_META_ID))
+    m61_bump(cache->stats.nactive, -arena->nobjects);
+    m61_bump(cache->stats.active_size, -arena->bytes);
+    m61_bump(cache->site_bytes[arena->site < M61_STATS_SITES ? arena->site : 0], -arena->bytes);
+    for (m61_arena_chunk *chunk = arena->chunks, *next; chunk; chunk = next)
     {
-        printf("MEMORY BUG: %s:%li: invalid free of pointer %p, not allocated\n", file, line, ptr);
-        //check to see if ptr is trying to free inside another heap block
-        header *bad_ptr = global_base.ptr_to_next;
-        //keep checking until end of list
-        while (bad_ptr != nullptr)
+        next = chunk->next;
+        header *meta = (header *)((char *)chunk - m61_lead());
+        m61_region *region = m61_find_region(meta);
+        if (!m61_block_intact(region, meta))
         {
-            if (ptr >= bad_ptr && ptr <= (char *)bad_ptr + sizeof(header) + bad_ptr->size)
-            {
-                size_t offset = (char *)ptr - ((char *)bad_ptr + sizeof(header));
-                printf("  %s:%li: %p is %zu bytes inside a %lu byte region allocated here\n",
-                       file, bad_ptr->line, ptr, offset, bad_ptr->size);
-                break;
-            }
-            //update bad_ptr to the next list item
-            bad_ptr = bad_ptr->ptr_to_next;
+            //an object ran off the end of the chunk. leave it be, the
+            //header can't be trusted, but untag it: the arena it names is
+            //about to go
+            printf("MEMORY BUG: %s:%li: detected wild write during destroy of arena %p\n", file, line,
+                   (void *)arena);
+            chunk->tag = 0;
+            continue;
         }
-        return;
+        m61_clear_live(region, m61_slot_of(region, meta));
+        chunk->tag = 0;
+        m61_recycle(cache, region, meta, chunk);
     }
-    //check to see if we've already freed
-    if (ptr_to_meta->is_active == 8008 && ptr_to_meta->metadata_id == MAGIC_META_ID)
+    delete arena;
+}
+
+/// m61_sum_statistics(stats)
+///    m61_get_statistics, but the caller holds cache_lock.
+static void m61_sum_statistics(m61_statistics *stats)
+{
+    //merge every thread's counters
+    memset(stats, 0, sizeof(m61_statistics));
+    for (m61_thread_cache *cache = all_caches; cache; cache = cache->next)
     {
-        printf("MEMORY BUG: invalid free of pointer %p, double free\n", ptr);
-        return;
+        stats->nactive += cache->stats.nactive.load(std::memory_order_relaxed);
+        stats->active_size += cache->stats.active_size.load(std::memory_order_relaxed);
+        stats->ntotal += cache->stats.ntotal.load(std::memory_order_relaxed);
+        stats->total_size += cache->stats.total_size.load(std::memory_order_relaxed);
+        stats->nfail += cache->stats.nfail.load(std::memory_order_relaxed);
+        stats->fail_size += cache->stats.fail_size.load(std::memory_order_relaxed);
     }
-    //test0023
-    //if our metadata's ptr_to_next is not a nullptr
-    if (ptr_to_meta->ptr_to_next != nullptr)
+    stats->heap_min = heap_min.load(std::memory_order_relaxed);
+    stats->heap_max = heap_max.load(std::memory_order_relaxed);
+}
+
+void m61_get_statistics(m61_statistics *stats)
+{
+    // Stub: set all statistics to enormous numbers
+    memset(stats, 255, sizeof(m61_statistics));
+    // Your code here.
+    std::lock_guard<std::mutex> guard(cache_lock);
+    m61_sum_statistics(stats);
+}
+
+/// m61_get_histograms(hist)
+///    Store the allocation histograms in `*hist`, adding up every
+///    thread's.
+void m61_get_histograms(m61_histograms *hist)
+{
+    memset(hist, 0, sizeof(m61_histograms));
+    std::lock_guard<std::mutex> guard(cache_lock);
+    for (m61_thread_cache *cache = all_caches; cache; cache = cache->next)
     {
-        //and our metadat's ptr_to_next's ptr_to_last isn't pointing at our metadata
-        if (ptr_to_meta->ptr_to_next->ptr_to_last != ptr_to_meta)
+        for (unsigned i = 0; i < M61_HIST_BUCKETS; ++i)
         {
-            //we know this allocation isn't in our list
-            printf("MEMORY BUG: %s:%li: invalid free of pointer %p, not allocated\n", file, line, ptr);
-            return;
+            hist->size[i] += cache->size_hist[i].load(std::memory_order_relaxed);
+            hist->lifetime[i] += cache->lifetime_hist[i].load(std::memory_order_relaxed);
+        }
+        for (unsigned i = 0; i < M61_STATS_SITES; ++i)
+        {
+            hist->site_live[i] += cache->site_bytes[i].load(std::memory_order_relaxed);
         }
     }
-    //if our metadata's ptr_to_last is not a nullptr
-    if (ptr_to_meta->ptr_to_last != nullptr)
+}
+
+/// m61_print_statistics()
+///    Print the current memory statistics.
+
+void m61_print_statistics()
+{
+    m61_statistics stats;
+    m61_get_statistics(&stats);
+
+    printf("alloc count: active %10llu   total %10llu   fail %10llu\n",
+           stats.nactive, stats.ntotal, stats.nfail);
+    printf("alloc size:  active %10llu   total %10llu   fail %10llu\n",
+           stats.active_size, stats.total_size, stats.fail_size);
+}
+
+//the leak report can run to millions of lines, so it's formatted by hand
+//into a buffer and written out a buffer at a time, rather than a printf a
+//line. it goes through stdout so it stays in order with everything else
+struct m61_writer
+{
+    char buf[1 << 16];
+    size_t len;
+};
+
+static void m61_flush(m61_writer &w)
+{
+    fwrite(w.buf, 1, w.len, stdout);
+    w.len = 0;
+}
+
+static void m61_put_slow(m61_writer &w, const char *s, size_t n)
+{
+    while (n != 0)
     {
-        //and our metadat's ptr_to_last's ptr_to_next isn't pointing at our metadata
-        if (ptr_to_meta->ptr_to_last->ptr_to_next != ptr_to_meta)
+        if (w.len == sizeof(w.buf))
         {
-            //we know this allocation isn't in our list
-            printf("MEMORY BUG: %s: %li: invalid free of pointer %p, not allocated\n", file, line, ptr);
-            return;
+            m61_flush(w);
         }
+        size_t k = std::min(n, sizeof(w.buf) - w.len);
+        memcpy(w.buf + w.len, s, k);
+        w.len += k;
+        s += k;
+        n -= k;
     }
+}
 
-    //taken from class answer at begining of last lecture thanks James?
-    char *ptr_to_trailer = (char *)ptr + ptr_to_meta->size;
-    if (*ptr_to_trailer != '@')
+//inlined so the length of a literal is worked out at compile time
+static inline void m61_put(m61_writer &w, const char *s)
+{
+    size_t n = strlen(s);
+    if (w.len + n > sizeof(w.buf))
     {
-        //we know our mem has been modified
-        printf("MEMORY BUG: %s:%li: detected wild write during free of pointer %p\n", file, line, ptr);
+        m61_put_slow(w, s, n);
         return;
     }
+    memcpy(w.buf + w.len, s, n);
+    w.len += n;
+}
 
-    //list updoots
-    if (ptr_to_meta->ptr_to_next != nullptr)
+/// m61_put_dec(w, n, negative)
+///    Append `n` in decimal, with a '-' if `negative`.
+static void m61_put_dec(m61_writer &w, unsigned long long n, bool negative = false)
+{
+    char digits[24];
+    char *p = digits + sizeof(digits);
+    *--p = 0;
+    do
+    {
+        *--p = '0' + n % 10;
+        n /= 10;
+    } while (n);
+    if (negative)
     {
-        (ptr_to_meta->ptr_to_next)->ptr_to_last = ptr_to_meta->ptr_to_last;
+        *--p = '-';
     }
-    if (ptr_to_meta->ptr_to_last != nullptr)
+    m61_put(w, p);
+}
+
+/// m61_put_ptr(w, p)
+///    Append `p` the way printf's %p does.
+static void m61_put_ptr(m61_writer &w, const void *ptr)
+{
+    char digits[24];
+    char *p = digits + sizeof(digits);
+    *--p = 0;
+    for (uintptr_t n = (uintptr_t)ptr; n; n >>= 4)
     {
-        (ptr_to_meta->ptr_to_last)->ptr_to_next = ptr_to_meta->ptr_to_next;
+        *--p = "0123456789abcdef"[n & 15];
     }
-    else
+    if (ptr == nullptr)
     {
-        global_base.ptr_to_next = ptr_to_meta->ptr_to_next;
+        m61_put(w, "(nil)");
+        return;
     }
+    *--p = 'x';
+    *--p = '0';
+    m61_put(w, p);
+}
 
-    //stat updoots
-    global_stats.nactive--;
-    global_stats.active_size -= (ptr_to_meta->size);
-    ptr_to_meta->is_active = 8008;
-
-    //free it
-    base_free(ptr_to_meta);
+/// m61_put_site(w, site)
+///    Append "LEAK CHECK: file:line: " for `site`. Caller holds site_lock.
+static void m61_put_site(m61_writer &w, unsigned site)
+{
+    m61_site &where = sites[site < sites.size() ? site : 0];
+    m61_put(w, "LEAK CHECK: ");
+    m61_put(w, where.file);
+    m61_put(w, ":");
+    m61_put_dec(w, where.line < 0 ? -(unsigned long long)where.line : where.line, where.line < 0);
+    m61_put(w, ": ");
 }
 
-/// m61_calloc(nmemb, sz, file, line)
-///    Return a pointer to newly-allocated dynamic memory big enough to
-///    hold an array of `nmemb` elements of `sz` bytes each. If `sz == 0`,
-///    then must return a unique, newly-allocated pointer value. Returned
-///    memory should be initialized to zero. The allocation request was at
-///    location `file`:`line`.
+//a site's (and with M61_LEAKS=stack, a backtrace's) live blocks
+struct m61_leak_group
+{
+    unsigned site;
+    unsigned stack;
+    unsigned long long bytes;
+    unsigned long long objects;
+};
 
-void *m61_calloc(size_t nmemb, size_t sz, const char *file, long line)
+/// m61_print_grouped_leaks(w, by_stack)
+///    M61_LEAKS=site's leak report: the live bytes and blocks of each site,
+///    or each site and backtrace with `by_stack`, biggest first. Caller
+///    holds region_lock and site_lock.
+static void m61_print_grouped_leaks(m61_writer &w, bool by_stack)
 {
-    // Your code here (to fix test014).
-    if ((nmemb * sz / nmemb) != sz)
+    std::vector<m61_leak_group> groups;
+    std::unordered_map<uint64_t, size_t> index;
+    for (auto &entry : region_index)
     {
-        global_stats.nfail++;
-        return nullptr;
+        m61_region *region = entry.second;
+        for (unsigned slot = 0; slot < region->nslots; ++slot)
+        {
+            if (!m61_slot_live(region, slot))
+            {
+                continue;
+            }
+            header *meta = (header *)(region->base + region->offset + slot * region->slot_size);
+            unsigned long long bytes = meta->size, objects = 1;
+            unsigned stack = by_stack && !region->stack.empty() ? region->stack[slot] : 0;
+            if (m61_arena *arena = m61_arena_of(meta))
+            {
+                //an arena counts its objects, once
+                if (arena->chunks != (m61_arena_chunk *)((char *)meta + m61_lead()))
+                {
+                    continue;
+                }
+                bytes = arena->bytes;
+                objects = arena->nobjects;
+                stack = 0;
+            }
+            auto it = index.emplace((uint64_t)meta->site << 32 | stack, groups.size()).first;
+            if (it->second == groups.size())
+            {
+                groups.push_back({meta->site, stack, 0, 0});
+            }
+            groups[it->second].bytes += bytes;
+            groups[it->second].objects += objects;
+        }
     }
-    void *ptr = m61_malloc(nmemb * sz, file, line);
-    if (ptr)
+    std::sort(groups.begin(), groups.end(), [](const m61_leak_group &a, const m61_leak_group &b)
+              { return a.bytes != b.bytes ? a.bytes > b.bytes : a.objects > b.objects; });
+
+    std::lock_guard<std::mutex> stack_guard(stack_lock);
+    for (m61_leak_group &group : groups)
     {
-        memset(ptr, 0, nmemb * sz);
+        m61_put_site(w, group.site);
+        m61_put_dec(w, group.bytes);
+        m61_put(w, " bytes in ");
+        m61_put_dec(w, group.objects);
+        m61_put(w, group.objects == 1 ? " object\n" : " objects\n");
+        if (group.stack == 0 || group.stack >= stacks.size())
+        {
+            continue;
+        }
+        m61_stack &stack = stacks[group.stack];
+        char **symbols = backtrace_symbols(stack.frames, stack.depth);
+        for (unsigned i = 0; i != stack.depth; ++i)
+        {
+            m61_put(w, "    #");
+            m61_put_dec(w, i);
+            m61_put(w, " ");
+            if (symbols)
+            {
+                m61_put(w, symbols[i]);
+            }
+            else
+            {
+                m61_put_ptr(w, stack.frames[i]);
+            }
+            m61_put(w, "\n");
+        }
+        free(symbols);
     }
-    return ptr;
 }
 
-/// m61_realloc(ptr, sz, file, line)
-///    Reallocate the dynamic memory pointed to by `ptr` to hold at least
-///    `sz` bytes, returning a pointer to the new block. If `ptr` is
-///    `nullptr`, behaves like `m61_malloc(sz, file, line)`. If `sz` is 0,
-///    behaves like `m61_free(ptr, file, line)`. The allocation request
-///    was at location `file`:`line`.
+//a site's share of the live blocks that were sampled
+struct m61_sampled_leak
+{
+    unsigned site;
+    unsigned long long samples; //sampled blocks still live
+    double bytes;               //estimated live bytes
+    double objects;             //estimated live blocks
+};
 
-void *m61_realloc(void *ptr, size_t sz, const char *file, long line)
+/// m61_print_sampled_leaks()
+///    Sampling mode's leak report: only sampled blocks know their site, so
+///    print each site's estimated live bytes and blocks, biggest first.
+static void m61_print_sampled_leaks()
 {
-    if (ptr == nullptr)
+    std::vector<m61_sampled_leak> leaks;
+    std::lock_guard<std::mutex> guard(region_lock);
+    std::lock_guard<std::mutex> site_guard(site_lock);
     {
-        void *ptr_to_return = m61_malloc(sz, file, line);
-        return ptr_to_return;
+        std::map<unsigned, size_t> index;
+        for (auto &entry : region_index)
+        {
+            m61_region *region = entry.second;
+            for (unsigned slot = 0; slot < region->nslots; ++slot)
+            {
+                header *meta = (header *)(region->base + region->offset + slot * region->slot_size);
+                if (!m61_slot_live(region, slot) || meta->site == 0)
+                {
+                    continue;
+                }
+                m61_arena *arena = m61_arena_of(meta);
+                if (arena && arena->chunks != (m61_arena_chunk *)((char *)meta + m61_lead()))
+                {
+                    continue;
+                }
+                auto it = index.emplace(meta->site, leaks.size()).first;
+                if (it->second == leaks.size())
+                {
+                    leaks.push_back({meta->site, 0, 0, 0});
+                }
+                m61_sampled_leak &leak = leaks[it->second];
+                if (arena)
+                {
+                    //arena objects are all counted, no need to guess
+                    leak.samples += arena->nobjects;
+                    leak.bytes += arena->bytes;
+                    leak.objects += arena->nobjects;
+                    continue;
+                }
+                double weight = m61_sample_weight(meta->size);
+                ++leak.samples;
+                leak.bytes += weight;
+                leak.objects += meta->size ? weight / meta->size : 1;
+            }
+        }
     }
-    if (sz == 0)
+    std::sort(leaks.begin(), leaks.end(), [](const m61_sampled_leak &a, const m61_sampled_leak &b)
+              { return a.bytes > b.bytes; });
+    for (m61_sampled_leak &leak : leaks)
     {
-        m61_free(ptr, file, line);
-        return ptr;
+        m61_site &where = sites[leak.site < sites.size() ? leak.site : 0];
+        printf("LEAK CHECK: %s:%li: ~%.0f bytes in ~%.0f objects (%llu sampled)\n",
+               where.file, where.line, leak.bytes, leak.objects, leak.samples);
     }
-    //request new memory of size sz
-    void *ptr_to_new_mem = m61_malloc(sz, file, line);
-    //get to our metadata so we can recover original size
-    header *ptr_to_meta = (header *)((char *)ptr - sizeof(header));
-    size_t original_size = ptr_to_meta->size;
-    //copy original stuff to new allocation
-    ptr_to_new_mem = std::memcpy(ptr_to_new_mem, ptr, original_size);
-
-    //free orig memory
-    m61_free(ptr, file, line);
-    return ptr_to_new_mem;
 }
 
-void m61_get_statistics(m61_statistics *stats)
+/// m61_print_leak_report()
+///    Print a report of all currently-active allocated blocks of dynamic
+///    memory.
+
+void m61_print_leak_report()
 {
-    // Stub: set all statistics to enormous numbers
-    memset(stats, 255, sizeof(m61_statistics));
     // Your code here.
-    *stats = global_stats;
+    if (m61_opts().sample)
+    {
+        m61_print_sampled_leaks();
+        return;
+    }
+    //regions are address ordered so the report is too. one writer will
+    //do, we hold region_lock
+    std::lock_guard<std::mutex> guard(region_lock);
+    std::lock_guard<std::mutex> site_guard(site_lock);
+    static m61_writer w;
+    if (m61_opts().leaks != M61_LEAKS_BLOCK)
+    {
+        m61_print_grouped_leaks(w, m61_opts().leaks == M61_LEAKS_STACK);
+        m61_flush(w);
+        return;
+    }
+    for (auto &entry : region_index)
+    {
+        m61_region *region = entry.second;
+        for (unsigned slot = 0; slot < region->nslots; ++slot)
+        {
+            if (!m61_slot_live(region, slot))
+            {
+                continue;
+            }
+            //get info from struct
+            header *meta = (header *)(region->base + region->offset + slot * region->slot_size);
+            //print info
+            if (m61_arena *arena = m61_arena_of(meta))
+            {
+                //one line per arena, at its newest chunk
+                if (arena->chunks == (m61_arena_chunk *)((char *)meta + m61_lead()))
+                {
+                    m61_put_site(w, meta->site);
+                    m61_put(w, "allocated arena ");
+                    m61_put_ptr(w, arena);
+                    m61_put(w, " with ");
+                    m61_put_dec(w, arena->nobjects);
+                    m61_put(w, " objects of ");
+                    m61_put_dec(w, arena->bytes);
+                    m61_put(w, " bytes\n");
+                }
+                continue;
+            }
+            m61_put_site(w, meta->site);
+            m61_put(w, "allocated object ");
+            m61_put_ptr(w, (char *)meta + m61_lead());
+            m61_put(w, " with size ");
+            m61_put_dec(w, meta->size);
+            m61_put(w, "\n");
+        }
+    }
+    m61_flush(w);
+    return;
 }
 
-/// m61_print_statistics()
-///    Print the current memory statistics.
+//set at exit so the background checker stops before the region index
+//goes away, protected by region_lock
+static bool checker_stopped;
 
-void m61_print_statistics()
+/// m61_scan_heap(background)
+///    m61_check_heap. The background checker passes true, and gets -1 back
+///    once the process is exiting.
+static int m61_scan_heap(bool background)
 {
-    m61_statistics stats;
-    m61_get_statistics(&stats);
+    //guard_lock keeps guard blocks from going PROT_NONE under us,
+    //region_lock keeps large regions from going away
+    std::lock_guard<std::mutex> guard(guard_lock);
+    std::lock_guard<std::mutex> region_guard(region_lock);
+    if (background && checker_stopped)
+    {
+        return -1;
+    }
+    std::lock_guard<std::mutex> site_guard(site_lock);
+    int damaged = 0;
+    for (auto &entry : region_index)
+    {
+        m61_region *region = entry.second;
+        for (unsigned slot = 0; slot < region->nslots; ++slot)
+        {
+            header *meta = (header *)(region->base + region->offset + slot * region->slot_size);
+            //the owner might free or realloc the block while we look, so
+            //only believe damage if the header didn't change meanwhile
+            bool damage = false;
+            for (int tries = 0; tries < 100 && m61_slot_live(region, slot); ++tries)
+            {
+                header before;
+                memcpy(&before, meta, sizeof(header));
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (m61_block_intact(region, meta))
+                {
+                    break;
+                }
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (memcmp(&before, meta, sizeof(header)) == 0 && m61_slot_live(region, slot))
+                {
+                    damage = true;
+                    break;
+                }
+            }
+            if (!damage)
+            {
+                continue;
+            }
+            m61_site &where = sites[meta->site < sites.size() ? meta->site : 0];
+            printf("MEMORY BUG: %s:%li: heap check detected wild write around pointer %p allocated here\n",
+                   where.file, where.line, (char *)meta + m61_lead());
+            ++damaged;
+        }
+    }
+    return damaged;
+}
 
-    printf("alloc count: active %10llu   total %10llu   fail %10llu\n",
-           stats.nactive, stats.ntotal, stats.nfail);
-    printf("alloc size:  active %10llu   total %10llu   fail %10llu\n",
-           stats.active_size, stats.total_size, stats.fail_size);
+int m61_check_heap()
+{
+    return m61_scan_heap(false);
 }
 
-/// m61_print_leak_report()
-///    Print a report of all currently-active allocated blocks of dynamic
-///    memory.
+static void m61_stop_checker()
+{
+    std::lock_guard<std::mutex> guard(region_lock);
+    checker_stopped = true;
+}
 
-void m61_print_leak_report()
+/// m61_start_checker(interval)
+///    Check the heap every `interval` ms on a background thread, until it
+///    finds damage (reported once) or the process exits.
+static void m61_start_checker(unsigned interval)
 {
-    // Your code here.
-    //we can itr over our list and print info from it
-    header *ptr_to_next = global_base.ptr_to_next;
-    //keep going until end of list
-    while (ptr_to_next != nullptr)
-    {
-        //get info from struct
-        const char *file = ptr_to_next->file;
-        long line = ptr_to_next->line;
-        size_t sz = ptr_to_next->size;
-        //print info
-        printf("LEAK CHECK: %s:%li: allocated object %p with size %zu\n", file, line, (header *)((char *)ptr_to_next + sizeof(header)), sz);
-        //update to next struct
-        ptr_to_next = ptr_to_next->ptr_to_next;
+    atexit(m61_stop_checker);
+    std::thread([interval] {
+        do
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+        } while (m61_scan_heap(true) == 0);
+        fflush(stdout);
+    }).detach();
+}
+
+//set at exit so the publisher stops before the site table goes away,
+//protected by cache_lock
+static bool publisher_stopped;
+
+/// m61_publish_stats(segment)
+///    Add up every cache's counters and copy them into `segment` under its
+///    seqlock. Returns false once the process is exiting.
+static bool m61_publish_stats(m61_stats_segment *segment)
+{
+    //only the publisher thread gets here, build the update off to the side
+    //so the seqlock is only held for the copy
+    static m61_stats_segment next;
+    std::lock_guard<std::mutex> guard(cache_lock);
+    if (publisher_stopped)
+    {
+        return false;
     }
-    return;
+    m61_sum_statistics(&next.stats);
+    for (unsigned i = 0; i < M61_NCLASSES; ++i)
+    {
+        next.class_size[i] = m61_slot_size(i) - sizeof(header);
+    }
+    memset(next.class_blocks, 0, sizeof(next.class_blocks));
+    memset(next.class_bytes, 0, sizeof(next.class_bytes));
+    uint64_t site_bytes[M61_STATS_SITES] = {};
+    for (m61_thread_cache *cache = all_caches; cache; cache = cache->next)
+    {
+        for (unsigned i = 0; i < M61_STATS_CLASSES; ++i)
+        {
+            next.class_blocks[i] += cache->class_blocks[i].load(std::memory_order_relaxed);
+            next.class_bytes[i] += cache->class_bytes[i].load(std::memory_order_relaxed);
+        }
+        for (unsigned i = 0; i < M61_STATS_SITES; ++i)
+        {
+            site_bytes[i] += cache->site_bytes[i].load(std::memory_order_relaxed);
+        }
+    }
+    {
+        //name sites the first time they show up
+        std::lock_guard<std::mutex> site_guard(site_lock);
+        unsigned nsites = std::min<size_t>(sites.size(), M61_STATS_SITES);
+        for (unsigned i = next.nsites; i < nsites; ++i)
+        {
+            const char *file = i ? sites[i].file : "(other sites)";
+            size_t length = strlen(file);
+            size_t room = sizeof(next.sites[i].file) - 1;
+            strncpy(next.sites[i].file, file + (length > room ? length - room : 0), room);
+            next.sites[i].line = sites[i].line;
+        }
+        next.nsites = nsites;
+    }
+    for (unsigned i = 0; i < next.nsites; ++i)
+    {
+        next.sites[i].live_bytes = site_bytes[i];
+    }
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    next.time = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    ++next.updates;
+
+    //the header fields never change, so only the rest needs the seqlock
+    uint64_t seq = segment->seq;
+    __atomic_store_n(&segment->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    size_t skip = offsetof(m61_stats_segment, time);
+    memcpy((char *)segment + skip, (char *)&next + skip, sizeof(next) - skip);
+    __atomic_store_n(&segment->seq, seq + 2, __ATOMIC_RELEASE);
+    return true;
+}
+
+static void m61_stop_publisher()
+{
+    std::lock_guard<std::mutex> guard(cache_lock);
+    publisher_stopped = true;
+}
+
+/// m61_start_publisher(segment, interval)
+///    Publish statistics to `segment` every `interval` ms on a background
+///    thread until the process exits.
+static void m61_start_publisher(m61_stats_segment *segment, unsigned interval)
+{
+    memcpy(segment->magic, M61_STATS_MAGIC, sizeof(segment->magic));
+    segment->version = M61_STATS_VERSION;
+    segment->segment_size = sizeof(m61_stats_segment);
+    segment->pid = getpid();
+    atexit(m61_stop_publisher);
+    std::thread([segment, interval] {
+        while (m61_publish_stats(segment))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+        }
+    }).detach();
 }
 
 /// m61_print_heavy_hitter_report()
@@ -319,64 +3073,64 @@ void m61_print_leak_report()
 
 void m61_print_heavy_hitter_report()
 {
-    // Your heavy-hitters code here
-    //TODO
-    //track usage
     //only have to track orig request sz NOT METADATA
     //20% or more use total_size to help calc
 
-    std::vector<heavy_hitters_item> local_heavy_hitters = {};
-    // FOR REF
-    // struct heavy_hitters_item
-    // {
-    //     const char *file;
-    //     long line;
-    //     size_t size;
-    //     //lets try a functor!
-    //     bool operator()(const heavy_hitters_item &x, const heavy_hitters_item &b) const
-    //     {
-    //         return x.size > b.size;
-    //     }
-    // };
-
-    //sorts by line number
-    std::sort(heavy_hitters_report_vector.begin(), heavy_hitters_report_vector.end(), cus_cmp);
+    //every thread keeps its own sketch, pool their counters. summed
+    //estimates still overcount by at most total_size / M61_HH_COUNTERS
+    std::vector<heavy_hitters_item> heavy_hitters_report_vector;
+    {
+        std::lock_guard<std::mutex> guard(cache_lock);
+        for (m61_thread_cache *cache = all_caches; cache; cache = cache->next)
+        {
+            for (unsigned i = 0; i < cache->heavy_hitters.n; ++i)
+            {
+                m61_hh_entry &e = cache->heavy_hitters.heap[i];
+                heavy_hitters_report_vector.push_back({e.site, e.bytes});
+            }
+        }
+    }
+    m61_statistics global_stats;
+    m61_get_statistics(&global_stats);
+    printf("total_size called: %llu bytes in %llu allocations\n", global_stats.total_size, global_stats.ntotal);
+    if (heavy_hitters_report_vector.empty())
+    {
+        return;
+    }
 
-    //add first elem and then loop through each hitter item
+    //sorts by site so the same site from different threads lines up
+    std::sort(heavy_hitters_report_vector.begin(), heavy_hitters_report_vector.end(), cus_cmp);
+    std::vector<heavy_hitters_item> local_heavy_hitters = {};
     local_heavy_hitters.push_back(heavy_hitters_report_vector.front());
-
-    for (int i = 1; i < (int)heavy_hitters_report_vector.size(); ++i)
+    for (size_t i = 1; i < heavy_hitters_report_vector.size(); ++i)
     {
-
-        //if file and line are the same
-        if (heavy_hitters_report_vector.at(i).file == local_heavy_hitters.back().file &&
-            heavy_hitters_report_vector.at(i).line == local_heavy_hitters.back().line)
+        //if the site is the same
+        if (heavy_hitters_report_vector[i].site == local_heavy_hitters.back().site)
         {
             //add the sizes
-            local_heavy_hitters.back().size += heavy_hitters_report_vector.at(i).size;
+            local_heavy_hitters.back().size += heavy_hitters_report_vector[i].size;
         }
         else
         {
             //we have a new addition to push to back
-
-            local_heavy_hitters.push_back(heavy_hitters_report_vector.at(i));
+            local_heavy_hitters.push_back(heavy_hitters_report_vector[i]);
         }
     }
     //sort our new local_heavy_hitters container with a functor!
     //sorts by size
     std::sort(local_heavy_hitters.begin(), local_heavy_hitters.end(), heavy_hitters_item());
-    printf("total_size called: %llu bytes in %llu allocations\n", global_stats.total_size, global_stats.ntotal);
-    int sum_of_calc_percent = 0;
-    for (int i = 0; i < 5; ++i)
+    for (size_t i = 0; i < 5 && i < local_heavy_hitters.size(); ++i)
     {
-        double calc_heavy_hitter_percent = (((double)local_heavy_hitters.at(i).size / (double)global_stats.total_size) * 100.0);
-        sum_of_calc_percent += (int)calc_heavy_hitter_percent;
+        double calc_heavy_hitter_percent = (((double)local_heavy_hitters[i].size / (double)global_stats.total_size) * 100.0);
+        const char *file;
+        long line;
+        m61_site_location(local_heavy_hitters[i].site, &file, &line);
 
         printf("HEAVY HITTER: %s:%li: %lu bytes(~%4.2f%%)\n",
-               local_heavy_hitters.at(i).file,
-               local_heavy_hitters.at(i).line,
-               local_heavy_hitters.at(i).size,
+               file,
+               line,
+               local_heavy_hitters[i].size,
                calc_heavy_hitter_percent);
     }
     return;
-}
\ No newline at end of file
+}
@@ -6,26 +6,26 @@
 #include <cstdio>
 #include <new>
 #include <list>
+#include <memory>
+#include <type_traits>
 #include <stdlib.h>
-#define MAGIC_META_ID 4206969
+//header states
+#define M61_ACTIVE 1337
+#define M61_FREED 8008
 
-// metadata map
+// metadata map, packed into 16 bytes
 struct header
 {
-    size_t size;                //user requested size 'payload'
-    int is_active;              //is this alloc active? 1337 = active 8008 = inactive
-    int metadata_id;            //used to id actual metadata
-    struct header *ptr_to_next; //pointer to next structure in list
-    struct header *ptr_to_last; //pointer to last structure in list "circular" list
-    const char *file;           // for leak report
-    long line;                  // for leak preort
+    uint64_t size : 48;         //user requested size 'payload'
+    uint64_t state : 16;        //M61_ACTIVE or M61_FREED
+    uint32_t site;              //interned file:line, for leak report
+    uint32_t check;             //checksum of the fields above and our address
 };
 
 //struct for collecting heavy hitters data
 struct heavy_hitters_item
 {
-    const char *file;  //for reporting
-    long line;        //for reporting
+    unsigned site;    //interned file:line, for reporting
     size_t size;      //size of item
     //lets try a functor! simple comparison returns t/f
     bool operator()(const heavy_hitters_item &x, const heavy_hitters_item &y) const
@@ -47,6 +47,87 @@ struct m61_statistics
     uintptr_t heap_max;             // largest allocated addr
 };
 
+//trace format. with M61_TRACE=file set, every malloc, free, calloc and
+//realloc is logged to `file`, which is an m61_trace_header followed by a
+//ring of `capacity` m61_trace_events (M61_TRACE_EVENTS, default 1<<20).
+//event i lives in slot i % capacity, so once `next` passes `capacity`
+//the ring holds events [next - capacity, next)
+#define M61_TRACE_MAGIC "M61TRACE"
+#define M61_TRACE_VERSION 1
+#define M61_TRACE_MALLOC 1
+#define M61_TRACE_FREE 2
+#define M61_TRACE_CALLOC 3
+#define M61_TRACE_REALLOC 4
+
+struct m61_trace_header
+{
+    char magic[8];          //M61_TRACE_MAGIC, no terminator
+    uint32_t version;       //M61_TRACE_VERSION
+    uint32_t event_size;    //sizeof(m61_trace_event)
+    uint64_t capacity;      //events the ring holds
+    uint64_t next;          //events logged so far
+};
+
+struct m61_trace_event
+{
+    uint64_t time;          //CLOCK_MONOTONIC ns
+    uint64_t addr;          //block returned, 0 if it failed; block freed for M61_TRACE_FREE
+    uint64_t old_addr;      //block passed to realloc
+    uint64_t size;          //bytes asked for (nmemb * sz for calloc)
+    uint32_t site;          //m61_site_id of file:line
+    uint16_t thread;        //small per-thread number, in order of first event
+    uint16_t op;            //M61_TRACE_*
+};
+
+//live statistics format. with M61_STATS=file set, a background thread
+//publishes the heap's state to `file` every M61_STATS_INTERVAL ms (default
+//100) for `m61top` to watch. the file is one m61_stats_segment, written
+//under a seqlock: `seq` is odd while an update is under way, so a reader
+//copies the segment and keeps it only if `seq` was even and unchanged
+#define M61_STATS_MAGIC "M61STATS"
+#define M61_STATS_VERSION 1
+//size classes, then large blocks, then guard blocks
+#define M61_STATS_CLASSES 25
+//per-site rows; sites with bigger ids are lumped into row 0
+#define M61_STATS_SITES 256
+
+struct m61_stats_site
+{
+    char file[56];                  //tail of the file name, NUL terminated
+    int64_t line;
+    uint64_t live_bytes;            //estimated under M61_SAMPLE
+};
+
+struct m61_stats_segment
+{
+    char magic[8];                  //M61_STATS_MAGIC, no terminator
+    uint32_t version;               //M61_STATS_VERSION
+    uint32_t segment_size;          //sizeof(m61_stats_segment)
+    uint64_t seq;                   //seqlock, odd while being written
+    uint64_t pid;
+    uint64_t time;                  //CLOCK_MONOTONIC ns of the last update
+    uint64_t updates;               //updates published so far
+    m61_statistics stats;
+    uint64_t class_size[M61_STATS_CLASSES];   //room after the header, 0 for large and guard blocks
+    uint64_t class_blocks[M61_STATS_CLASSES]; //live blocks
+    uint64_t class_bytes[M61_STATS_CLASSES];  //live payload bytes
+    uint32_t nsites;                //rows of `sites` in use
+    uint32_t padding;
+    m61_stats_site sites[M61_STATS_SITES];
+};
+
+//histograms are log2 bucketed: bucket b counts values of bit width b,
+//so [2^(b-1), 2^b), and bucket 0 counts 0
+#define M61_HIST_BUCKETS 64
+
+///    Structure holding allocation histograms.
+struct m61_histograms
+{
+    unsigned long long size[M61_HIST_BUCKETS];      // allocations by size in bytes
+    unsigned long long lifetime[M61_HIST_BUCKETS];  // frees by lifetime in allocation ticks
+    unsigned long long site_live[M61_STATS_SITES];  // live bytes by m61_site_id, sites past the end in 0
+};
+
 //custom compare function def
 bool cus_cmp(const heavy_hitters_item &x, const heavy_hitters_item &y);
 
@@ -54,10 +135,35 @@ bool cus_cmp(const heavy_hitters_item &x, const heavy_hitters_item &y);
 ///    Return a pointer to `sz` bytes of newly-allocated dynamic memory.
 void *m61_malloc(size_t sz, const char *file, long line);
 
+/// m61_malloc_at_least(sz, room, file, line)
+///    Like m61_malloc, but the block may be bigger than `sz`: its whole
+///    size is stored in `*room`, and the caller may use all of it.
+void *m61_malloc_at_least(size_t sz, size_t *room, const char *file, long line);
+
 /// m61_free(ptr, file, line)
 ///    Free the memory space pointed to by `ptr`.
 void m61_free(void *ptr, const char *file, long line);
 
+/// m61_aligned_alloc(align, sz, file, line)
+///    Like m61_malloc, but the block is aligned to `align`, which must be a
+///    power of two. Alignments small blocks don't have anyway (8, 16 for
+///    some sizes, 64 under M61_CACHELINE) may cost a page.
+void *m61_aligned_alloc(size_t align, size_t sz, const char *file, long line);
+
+/// m61_memalign(align, sz, file, line)
+///    The same as m61_aligned_alloc.
+void *m61_memalign(size_t align, size_t sz, const char *file, long line);
+
+/// m61_malloc_batch(n, sz, out, file, line)
+///    Allocate `n` blocks of `sz` bytes, storing them in `out[0]` through
+///    `out[n-1]`, and return how many were allocated: fewer than `n` only
+///    if an allocation failed. Cheaper than `n` calls to m61_malloc.
+size_t m61_malloc_batch(size_t n, size_t sz, void **out, const char *file, long line);
+
+/// m61_free_batch(ptrs, n, file, line)
+///    Free the `n` blocks in `ptrs`, as if by m61_free on each in turn.
+void m61_free_batch(void **ptrs, size_t n, const char *file, long line);
+
 /// m61_calloc(nmemb, sz, file, line)
 ///    Return a pointer to newly-allocated dynamic memory big enough to
 ///    hold an array of `nmemb` elements of `sz` bytes each. The memory
@@ -73,27 +179,98 @@ void *m61_calloc(size_t nmemb, size_t sz, const char *file, long line);
 
 void *m61_realloc(void *ptr, size_t sz, const char *file, long line);
 
+/// m61_arena_create(file, line)
+///    Return a new arena: many objects allocated with m61_arena_alloc and
+///    freed together by m61_arena_destroy. Objects count in the statistics
+///    and the leak report under `file`:`line`, but not in the lifetime
+///    histogram. Use an arena from one thread at a time.
+struct m61_arena;
+m61_arena *m61_arena_create(const char *file, long line);
+
+/// m61_arena_alloc(arena, sz)
+///    Return `sz` bytes from `arena`, 16-byte aligned, or nullptr. Don't
+///    free them; they go away with the arena.
+void *m61_arena_alloc(m61_arena *arena, size_t sz);
+
+/// m61_arena_destroy(arena, file, line)
+///    Free `arena` and every object allocated from it. The destroy was
+///    called at location `file`:`line`.
+void m61_arena_destroy(m61_arena *arena, const char *file, long line);
+
+///    What m61_block_info knows about a block.
+struct m61_block
+{
+    void *base;         // first payload byte
+    size_t size;        // payload bytes, 0 when unknown
+    const char *file;   // allocation site, "?" when unknown or not sampled
+    long line;
+    unsigned state;     // M61_ACTIVE, M61_FREED, or 0 if unknown or never allocated
+};
+
+/// m61_block_info(ptr, info)
+///    If `ptr` points anywhere into a block of ours, even its header or
+///    canaries, and even if it's freed, describe that block in `*info` and
+///    return true. Return false otherwise. Lock free outside guard mode,
+///    and takes about as long as a free.
+bool m61_block_info(const void *ptr, m61_block *info);
+
+/// m61_owns(ptr)
+///    Return true if `ptr` points into the payload of an active block.
+///    Lock free outside guard mode; never looks up the allocation site.
+bool m61_owns(const void *ptr);
+
+/// m61_site_id(file, line)
+///    Return the 32-bit id of allocation site `file`:`line`, interning it
+///    on first use. Ids are small consecutive integers starting at 1.
+unsigned m61_site_id(const char *file, long line);
+
+/// m61_site_location(site, file, line)
+///    Store the file and line interned as `site` in `*file` and `*line`.
+///    Unknown ids give "?" and 0.
+void m61_site_location(unsigned site, const char **file, long *line);
+
 /// m61_get_statistics(stats)
-///    Store the current memory statistics in `*stats`.
+///    Store the current memory statistics in `*stats`. Every thread keeps
+///    its own counters; this adds them up.
 void m61_get_statistics(m61_statistics *stats);
 
+/// m61_get_histograms(hist)
+///    Store allocation histograms in `*hist`: how many allocations there
+///    were of each size, how long freed blocks lived and how many bytes
+///    each site has live. A block's lifetime is the number of allocations
+///    the thread that allocated it made before it was freed. Under
+///    M61_SAMPLE, site_live holds estimates.
+void m61_get_histograms(m61_histograms *hist);
+
 /// m61_print_statistics()
 ///    Print the current memory statistics.
 void m61_print_statistics();
 
 /// m61_print_leak_report()
 ///    Print a report of all currently-active allocated blocks of dynamic
-///    memory.
+///    memory. Call it while other threads aren't allocating.
 void m61_print_leak_report();
 
 /// m61_print_heavy_hitter_report()
-///    Print a report of heavily-used allocation locations.
+///    Print a report of heavily-used allocation locations. Call it while
+///    other threads aren't allocating.
 void m61_print_heavy_hitter_report();
 
+/// m61_check_heap()
+///    Check the header and canaries of every active block, printing a
+///    MEMORY BUG report for each damaged one, and return how many there
+///    were. Safe to call while other threads allocate. With
+///    M61_CHECK_INTERVAL=ms set it also runs that often in the background.
+int m61_check_heap();
+
 /// `m61.cc` should use these functions rather than malloc() and free().
 void *base_malloc(size_t sz);
 void base_free(void *ptr);
 void base_allocator_disable(bool is_disabled);
+/// base_contains(ptr)
+///    Return true if `ptr` is inside a block base_malloc handed out, live
+///    or freed. Never reads the memory at `ptr`.
+bool base_contains(const void *ptr);
 
 /// Override system versions with our versions.
 #if !M61_DISABLE
@@ -101,39 +278,114 @@ void base_allocator_disable(bool is_disabled);
 #define free(ptr) m61_free((ptr), __FILE__, __LINE__)
 #define calloc(nmemb, sz) m61_calloc((nmemb), (sz), __FILE__, __LINE__)
 #define realloc(ptr, new_sz) m61_realloc((ptr), (new_sz), __FILE__, __LINE__)
+#define aligned_alloc(align, sz) m61_aligned_alloc((align), (sz), __FILE__, __LINE__)
+
+#endif
 
+/// m61_allocation_result<T>
+///    What m61_allocator<T>::allocate_at_least returns: `ptr` has room for
+///    `count` objects. It's std::allocation_result where there is one, so
+///    std::allocator_traits picks the member up.
+#if __cpp_lib_allocate_at_least
+template <typename T>
+using m61_allocation_result = std::allocation_result<T *, size_t>;
+#else
+template <typename T>
+struct m61_allocation_result
+{
+    T *ptr;
+    size_t count;
+};
 #endif
 
 /// This magic class lets standard C++ containers use your debugging allocator,
 /// instead of the system allocator.
+///
+/// A default one allocates with m61_malloc at site "?". Give it a site, as
+/// in `m61_allocator<T>(__FILE__, __LINE__)`, and the leak report and
+/// statistics say where a container's memory came from; give it an arena
+/// too and the container allocates from the arena, its deallocations do
+/// nothing and its memory goes when the arena is destroyed. Copies, including
+/// rebound ones, keep the arena and the site, and containers carry them
+/// along on copy and move assignment and swap, so memory is always given
+/// back to where it came from.
 template <typename T>
 class m61_allocator
 {
 public:
     using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    using is_always_equal = std::false_type;
+
     m61_allocator() noexcept = default;
+    m61_allocator(const char *file, long line) noexcept
+        : file_(file), line_(line) {}
+    explicit m61_allocator(m61_arena *arena, const char *file = "?", long line = 0) noexcept
+        : arena_(arena), file_(file), line_(line) {}
     m61_allocator(const m61_allocator<T> &) noexcept = default;
     template <typename U>
-    m61_allocator(m61_allocator<U> &) noexcept {}
+    m61_allocator(const m61_allocator<U> &other) noexcept
+        : arena_(other.arena()), file_(other.file()), line_(other.line()) {}
 
     T *allocate(size_t n)
     {
-        return reinterpret_cast<T *>(m61_malloc(n * sizeof(T), "?", 0));
+        if (arena_)
+        {
+            return reinterpret_cast<T *>(m61_arena_alloc(arena_, n * sizeof(T)));
+        }
+        return reinterpret_cast<T *>(m61_malloc(n * sizeof(T), file_, line_));
+    }
+    /// allocate_at_least(n)
+    ///    Allocate room for at least `n` objects, saying how many really fit.
+    m61_allocation_result<T> allocate_at_least(size_t n)
+    {
+        if (arena_)
+        {
+            return {allocate(n), n};
+        }
+        size_t room;
+        T *ptr = reinterpret_cast<T *>(m61_malloc_at_least(n * sizeof(T), &room, file_, line_));
+        return {ptr, room / sizeof(T)};
     }
     void deallocate(T *ptr, size_t)
     {
-        m61_free(ptr, "?", 0);
+        if (!arena_)
+        {
+            m61_free(ptr, file_, line_);
+        }
     }
+
+    m61_arena *arena() const noexcept
+    {
+        return arena_;
+    }
+    const char *file() const noexcept
+    {
+        return file_;
+    }
+    long line() const noexcept
+    {
+        return line_;
+    }
+
+private:
+    m61_arena *arena_ = nullptr;
+    const char *file_ = "?";
+    long line_ = 0;
 };
+//memory from one can go back through the other when they share an arena,
+//or both have none. the site only labels allocations
 template <typename T, typename U>
-inline constexpr bool operator==(const m61_allocator<T> &, const m61_allocator<U> &)
+inline bool operator==(const m61_allocator<T> &a, const m61_allocator<U> &b)
 {
-    return true;
+    return a.arena() == b.arena();
 }
 template <typename T, typename U>
-inline constexpr bool operator!=(const m61_allocator<T> &, const m61_allocator<U> &)
+inline bool operator!=(const m61_allocator<T> &a, const m61_allocator<U> &b)
 {
-    return false;
+    return a.arena() != b.arena();
 }
 
 #endif
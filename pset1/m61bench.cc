@@ -0,0 +1,425 @@
+#define M61_DISABLE 1
+#include "m61.hh"
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+// m61bench: Allocator microbenchmarks for m61, base_malloc and the system
+// allocator. Prints one JSON array with a result object per benchmark run.
+
+// An allocator under test. `free` and `realloc` get the block's size,
+// which base_malloc needs to fake realloc.
+struct bench_allocator {
+    const char* name;
+    void* (*malloc)(size_t sz);
+    void (*free)(void* ptr, size_t sz);
+    void* (*calloc)(size_t nmemb, size_t sz);
+    void* (*realloc)(void* ptr, size_t old_sz, size_t sz);
+};
+
+static void* m61_bench_malloc(size_t sz) { return m61_malloc(sz, "bench", 0); }
+static void m61_bench_free(void* ptr, size_t) { m61_free(ptr, "bench", 0); }
+static void* m61_bench_calloc(size_t n, size_t sz) { return m61_calloc(n, sz, "bench", 0); }
+static void* m61_bench_realloc(void* ptr, size_t, size_t sz) { return m61_realloc(ptr, sz, "bench", 0); }
+
+// the base allocator isn't thread safe
+static std::mutex base_lock;
+static void* base_bench_malloc(size_t sz) {
+    std::lock_guard<std::mutex> guard(base_lock);
+    return base_malloc(sz);
+}
+static void base_bench_free(void* ptr, size_t) {
+    std::lock_guard<std::mutex> guard(base_lock);
+    base_free(ptr);
+}
+static void* base_bench_calloc(size_t n, size_t sz) {
+    void* ptr = base_bench_malloc(n * sz);
+    if (ptr) {
+        memset(ptr, 0, n * sz);
+    }
+    return ptr;
+}
+static void* base_bench_realloc(void* ptr, size_t old_sz, size_t sz) {
+    void* next = base_bench_malloc(sz);
+    if (next && ptr) {
+        memcpy(next, ptr, old_sz < sz ? old_sz : sz);
+        base_bench_free(ptr, old_sz);
+    }
+    return next;
+}
+
+static void* sys_bench_malloc(size_t sz) { return malloc(sz); }
+static void sys_bench_free(void* ptr, size_t) { free(ptr); }
+static void* sys_bench_calloc(size_t n, size_t sz) { return calloc(n, sz); }
+static void* sys_bench_realloc(void* ptr, size_t, size_t sz) { return realloc(ptr, sz); }
+
+static const bench_allocator allocators[] = {
+    {"m61", m61_bench_malloc, m61_bench_free, m61_bench_calloc, m61_bench_realloc},
+    {"base", base_bench_malloc, base_bench_free, base_bench_calloc, base_bench_realloc},
+    {"glibc", sys_bench_malloc, sys_bench_free, sys_bench_calloc, sys_bench_realloc}
+};
+
+static uint64_t now_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+// Latency histogram: 16 linear buckets per power of two, so percentiles
+// come out within ~6% without keeping every sample (which would show up
+// in the RSS we're measuring).
+struct latency_hist {
+    unsigned long long count[64][16];
+
+    void add(uint64_t ns) {
+        if (ns < 16) {
+            ++count[0][ns];
+        } else {
+            int lg = 63 - __builtin_clzll(ns);
+            ++count[lg][(ns >> (lg - 4)) & 15];
+        }
+    }
+    void merge(const latency_hist& other) {
+        for (int lg = 0; lg < 64; ++lg) {
+            for (int sub = 0; sub < 16; ++sub) {
+                count[lg][sub] += other.count[lg][sub];
+            }
+        }
+    }
+    unsigned long long total() const {
+        unsigned long long n = 0;
+        for (int lg = 0; lg < 64; ++lg) {
+            for (int sub = 0; sub < 16; ++sub) {
+                n += count[lg][sub];
+            }
+        }
+        return n;
+    }
+    uint64_t percentile(double p) const {
+        unsigned long long rank = (unsigned long long) (p * total());
+        unsigned long long seen = 0;
+        for (int lg = 0; lg < 64; ++lg) {
+            for (int sub = 0; sub < 16; ++sub) {
+                seen += count[lg][sub];
+                if (seen > rank) {
+                    return lg == 0 ? sub : (uint64_t) (16 + sub) << (lg - 4);
+                }
+            }
+        }
+        return 0;
+    }
+};
+
+
+// Per-run state shared by a benchmark's threads
+struct bench_state {
+    const bench_allocator* a;
+    std::mutex lock;
+    latency_hist hist;
+    std::atomic<long long> live{0};
+    std::atomic<long long> peak_live{0};
+    uintptr_t heap_min = UINTPTR_MAX;
+    uintptr_t heap_max = 0;
+};
+
+// What one thread has seen; merged into the bench_state when it's done.
+struct bench_thread {
+    bench_state& st;
+    latency_hist hist;
+    uintptr_t heap_min = UINTPTR_MAX;
+    uintptr_t heap_max = 0;
+
+    bench_thread(bench_state& s)
+        : st(s) {
+        memset(&hist, 0, sizeof(hist));
+    }
+    ~bench_thread() {
+        std::lock_guard<std::mutex> guard(st.lock);
+        st.hist.merge(hist);
+        st.heap_min = std::min(st.heap_min, heap_min);
+        st.heap_max = std::max(st.heap_max, heap_max);
+    }
+
+    void note(void* ptr, size_t sz, long long delta) {
+        if (ptr) {
+            heap_min = std::min(heap_min, (uintptr_t) ptr);
+            heap_max = std::max(heap_max, (uintptr_t) ptr + sz);
+        }
+        long long live = st.live.fetch_add(delta, std::memory_order_relaxed) + delta;
+        long long peak = st.peak_live.load(std::memory_order_relaxed);
+        while (live > peak
+               && !st.peak_live.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+        }
+    }
+    void* malloc(size_t sz) {
+        uint64_t t0 = now_ns();
+        void* ptr = st.a->malloc(sz);
+        hist.add(now_ns() - t0);
+        note(ptr, sz, sz);
+        return ptr;
+    }
+    void* calloc(size_t n, size_t sz) {
+        uint64_t t0 = now_ns();
+        void* ptr = st.a->calloc(n, sz);
+        hist.add(now_ns() - t0);
+        note(ptr, n * sz, n * sz);
+        return ptr;
+    }
+    void* realloc(void* ptr, size_t old_sz, size_t sz) {
+        uint64_t t0 = now_ns();
+        void* next = st.a->realloc(ptr, old_sz, sz);
+        hist.add(now_ns() - t0);
+        note(next, sz, (long long) sz - (long long) old_sz);
+        return next;
+    }
+    void free(void* ptr, size_t sz) {
+        if (ptr) {
+            uint64_t t0 = now_ns();
+            st.a->free(ptr, sz);
+            hist.add(now_ns() - t0);
+            note(nullptr, 0, -(long long) sz);
+        }
+    }
+};
+
+static unsigned long long xorshift(unsigned long long& x) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return x;
+}
+
+
+// churn: one thread freeing and reallocating random slots of one size
+static void bench_churn(bench_state& st, int) {
+    bench_thread t(st);
+    const int nslots = 4096;
+    std::vector<void*> slots(nslots, nullptr);
+    unsigned long long x = 88172645463325252ULL;
+    for (int i = 0; i != 1000000; ++i) {
+        int s = xorshift(x) % nslots;
+        t.free(slots[s], 64);
+        slots[s] = t.malloc(64);
+    }
+    for (void* ptr : slots) {
+        t.free(ptr, 64);
+    }
+}
+
+// larson: every round each thread frees and replaces random blocks of
+// random sizes, then the block arrays move one thread over, so most
+// frees are of blocks another thread allocated
+struct larson_block {
+    void* ptr;
+    size_t size;
+};
+
+static void bench_larson(bench_state& st, int nthreads) {
+    const int nslots = 2048, nrounds = 8, nops = 400000 / nthreads;
+    std::vector<std::vector<larson_block>> arrays(nthreads,
+        std::vector<larson_block>(nslots, larson_block{nullptr, 0}));
+    for (int round = 0; round != nrounds; ++round) {
+        std::vector<std::thread> th;
+        for (int i = 0; i != nthreads; ++i) {
+            th.emplace_back([&, i, round] {
+                bench_thread t(st);
+                std::vector<larson_block>& blocks = arrays[(i + round) % nthreads];
+                unsigned long long x = 0x9E3779B97F4A7C15ULL * (i + 1) + round;
+                for (int op = 0; op != nops; ++op) {
+                    larson_block& b = blocks[xorshift(x) % nslots];
+                    t.free(b.ptr, b.size);
+                    b.size = 16 + xorshift(x) % 497;
+                    b.ptr = t.malloc(b.size);
+                }
+            });
+        }
+        for (auto& thr : th) {
+            thr.join();
+        }
+    }
+    bench_thread t(st);
+    for (auto& blocks : arrays) {
+        for (auto& b : blocks) {
+            t.free(b.ptr, b.size);
+        }
+    }
+}
+
+// realloc: grow 64 interleaved buffers a little at a time up to 256 KiB
+static void bench_realloc(bench_state& st, int) {
+    bench_thread t(st);
+    const int nbufs = 64;
+    void* bufs[nbufs] = {};
+    size_t sizes[nbufs] = {};
+    unsigned long long x = 2463534242ULL;
+    bool growing = true;
+    while (growing) {
+        growing = false;
+        for (int i = 0; i != nbufs; ++i) {
+            if (sizes[i] < 256 * 1024) {
+                size_t next = sizes[i] + 1 + xorshift(x) % 64;
+                bufs[i] = t.realloc(bufs[i], sizes[i], next);
+                ((char*) bufs[i])[next - 1] = 1;
+                sizes[i] = next;
+                growing = true;
+            }
+        }
+    }
+    for (int i = 0; i != nbufs; ++i) {
+        t.free(bufs[i], sizes[i]);
+    }
+}
+
+// calloc: big zeroed arrays, of which only a little gets touched
+static void bench_calloc(bench_state& st, int) {
+    bench_thread t(st);
+    const size_t sz = 8 << 20;
+    for (int i = 0; i != 64; ++i) {
+        char* ptr = (char*) t.calloc(sz / 8, 8);
+        for (size_t off = 0; off < sz; off += 256 * 1024) {
+            ptr[off] = 1;
+        }
+        t.free(ptr, sz);
+    }
+}
+
+// prodcons: one thread allocates, another frees, through a ring
+static void bench_prodcons(bench_state& st, int) {
+    const unsigned ncap = 1024, nitems = 300000;
+    std::vector<std::atomic<void*>> ring(ncap);
+    std::vector<size_t> sizes(ncap);
+    std::atomic<unsigned> head{0}, tail{0};
+    std::thread producer([&] {
+        bench_thread t(st);
+        unsigned long long x = 1181783497276652981ULL;
+        for (unsigned i = 0; i != nitems; ++i) {
+            while (i - tail.load(std::memory_order_acquire) >= ncap) {
+                std::this_thread::yield();
+            }
+            size_t sz = 16 + xorshift(x) % 241;
+            sizes[i % ncap] = sz;
+            ring[i % ncap].store(t.malloc(sz), std::memory_order_relaxed);
+            head.store(i + 1, std::memory_order_release);
+        }
+    });
+    std::thread consumer([&] {
+        bench_thread t(st);
+        for (unsigned i = 0; i != nitems; ++i) {
+            while (head.load(std::memory_order_acquire) == i) {
+                std::this_thread::yield();
+            }
+            t.free(ring[i % ncap].load(std::memory_order_relaxed), sizes[i % ncap]);
+            tail.store(i + 1, std::memory_order_release);
+        }
+    });
+    producer.join();
+    consumer.join();
+}
+
+struct bench {
+    const char* name;
+    void (*run)(bench_state& st, int nthreads);
+    int nthreads;
+};
+
+static const bench benches[] = {
+    {"churn", bench_churn, 1},
+    {"larson", bench_larson, 1},
+    {"larson", bench_larson, 2},
+    {"larson", bench_larson, 4},
+    {"realloc", bench_realloc, 1},
+    {"calloc", bench_calloc, 1},
+    {"prodcons", bench_prodcons, 2}
+};
+
+
+// Run one benchmark against one allocator and print its result object.
+// Each run gets its own process so peak RSS means something.
+// `fragmentation` is the span of addresses handed out over peak live
+// bytes; it blows up for allocators that mix heap and mmap addresses, so
+// `rss_per_live` (peak RSS over peak live bytes) is there too.
+static void run_one(const bench& b, const bench_allocator& a) {
+    bench_state* st = new bench_state;
+    memset(&st->hist, 0, sizeof(st->hist));
+    st->a = &a;
+    uint64_t t0 = now_ns();
+    b.run(*st, b.nthreads);
+    double seconds = (now_ns() - t0) / 1e9;
+
+    rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    unsigned long long ops = st->hist.total();
+    long long peak = st->peak_live.load();
+    uintptr_t span = st->heap_max > st->heap_min ? st->heap_max - st->heap_min : 0;
+    printf("  {\"bench\": \"%s\", \"allocator\": \"%s\", \"threads\": %d, "
+           "\"ops\": %llu, \"seconds\": %.4f, \"ops_per_sec\": %.0f, "
+           "\"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, "
+           "\"peak_rss_kb\": %ld, \"peak_live_bytes\": %lld, "
+           "\"heap_span_bytes\": %llu, \"fragmentation\": %.3f, \"rss_per_live\": %.3f",
+           b.name, a.name, b.nthreads, ops, seconds, ops / seconds,
+           (unsigned long long) st->hist.percentile(0.5),
+           (unsigned long long) st->hist.percentile(0.99),
+           (unsigned long long) st->hist.percentile(0.999),
+           ru.ru_maxrss, peak, (unsigned long long) span,
+           peak > 0 ? (double) span / peak : 0.0,
+           peak > 0 ? ru.ru_maxrss * 1024.0 / peak : 0.0);
+    if (&a == &allocators[0]) {
+        // m61 keeps its own view: address range it handed out vs live bytes
+        m61_statistics stats;
+        m61_get_statistics(&stats);
+        printf(", \"m61_heap_span_bytes\": %llu, \"m61_active_size\": %llu",
+               (unsigned long long) (stats.heap_max - stats.heap_min),
+               stats.active_size);
+    }
+    printf("}");
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && (strcmp(argv[1], "-h") == 0
+                     || strcmp(argv[1], "--help") == 0)) {
+        printf("Usage: ./m61bench [BENCH...]\n\
+\n\
+  Runs allocator benchmarks against m61, base_malloc and glibc malloc\n\
+  and prints the results as a JSON array. BENCH limits the run to the\n\
+  named benchmarks: churn, larson, realloc, calloc, prodcons.\n");
+        exit(0);
+    }
+
+    printf("[\n");
+    bool first = true;
+    for (const bench& b : benches) {
+        bool wanted = argc == 1;
+        for (int i = 1; i < argc; ++i) {
+            wanted = wanted || strcmp(argv[i], b.name) == 0;
+        }
+        if (!wanted) {
+            continue;
+        }
+        for (const bench_allocator& a : allocators) {
+            printf("%s", first ? "" : ",\n");
+            first = false;
+            fflush(stdout);
+            pid_t p = fork();
+            if (p == 0) {
+                run_one(b, a);
+                _exit(0);
+            }
+            int status;
+            waitpid(p, &status, 0);
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                printf("  {\"bench\": \"%s\", \"allocator\": \"%s\", \"threads\": %d, \"error\": true}",
+                       b.name, a.name, b.nthreads);
+            }
+        }
+    }
+    printf("\n]\n");
+}
@@ -0,0 +1,181 @@
+#define M61_DISABLE 1
+#include "m61.hh"
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <time.h>
+#include <sys/resource.h>
+// m61replay: Replay an M61_TRACE trace against m61 or the system allocator.
+
+static bool use_system = false;
+
+static void* do_malloc(size_t sz, unsigned site) {
+    return use_system ? malloc(sz) : m61_malloc(sz, "trace", site);
+}
+static void* do_calloc(size_t sz, unsigned site) {
+    return use_system ? calloc(1, sz) : m61_calloc(1, sz, "trace", site);
+}
+static void* do_realloc(void* ptr, size_t sz, unsigned site) {
+    return use_system ? realloc(ptr, sz) : m61_realloc(ptr, sz, "trace", site);
+}
+static void do_free(void* ptr, unsigned site) {
+    if (use_system) {
+        free(ptr);
+    } else {
+        m61_free(ptr, "trace", site);
+    }
+}
+
+static uint64_t now_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// A block from the trace that's live in the replay
+struct replay_block {
+    void* ptr;
+    size_t size;
+};
+
+int main(int argc, char** argv) {
+    int arg = 1;
+    if (arg < argc && strcmp(argv[arg], "-s") == 0) {
+        use_system = true;
+        ++arg;
+    }
+    if (arg + 1 != argc || argv[arg][0] == '-') {
+        fprintf(stderr, "Usage: ./m61replay [-s] TRACE\n\
+\n\
+  Replays a trace recorded with M61_TRACE=TRACE against m61, or against\n\
+  the system allocator with -s, and reports per-call latency, peak live\n\
+  bytes and peak RSS. Events replay in trace order on one thread, so two\n\
+  runs over the same trace do the same work.\n");
+        exit(1);
+    }
+
+    FILE* f = fopen(argv[arg], "rb");
+    m61_trace_header th;
+    if (!f || fread(&th, sizeof(th), 1, f) != 1
+        || memcmp(th.magic, M61_TRACE_MAGIC, sizeof(th.magic)) != 0
+        || th.version != M61_TRACE_VERSION
+        || th.event_size != sizeof(m61_trace_event)
+        || th.capacity == 0) {
+        fprintf(stderr, "m61replay: %s: not an m61 trace\n", argv[arg]);
+        exit(1);
+    }
+
+    // the ring holds the last `capacity` events, oldest first from `next`.
+    // read it a chunk at a time so it doesn't count toward our RSS
+    uint64_t first = th.next > th.capacity ? th.next - th.capacity : 0;
+    std::vector<m61_trace_event> chunk(4096);
+    size_t chunk_slot = 0, chunk_count = 0;
+    std::unordered_map<uint64_t, replay_block> live;
+    std::vector<uint64_t> latency;
+    unsigned long long counts[5] = {0, 0, 0, 0, 0};
+    unsigned long long skipped = 0;
+    size_t live_bytes = 0, peak_bytes = 0;
+
+    for (uint64_t i = first; i < th.next; ++i) {
+        size_t slot = i % th.capacity;
+        if (slot < chunk_slot || slot >= chunk_slot + chunk_count) {
+            chunk_slot = slot;
+            fseek(f, sizeof(th) + slot * sizeof(m61_trace_event), SEEK_SET);
+            chunk_count = fread(chunk.data(), sizeof(m61_trace_event),
+                                std::min<size_t>(chunk.size(), th.capacity - slot), f);
+            if (chunk_count == 0) {
+                // truncated trace
+                break;
+            }
+        }
+        const m61_trace_event& e = chunk[slot - chunk_slot];
+        uint64_t start, end;
+        if (e.op == M61_TRACE_MALLOC || e.op == M61_TRACE_CALLOC) {
+            if (e.addr == 0) {
+                // failed when traced
+                ++skipped;
+                continue;
+            }
+            start = now_ns();
+            void* ptr = e.op == M61_TRACE_MALLOC ? do_malloc(e.size, e.site)
+                : do_calloc(e.size, e.site);
+            end = now_ns();
+            live[e.addr] = {ptr, e.size};
+            live_bytes += e.size;
+        } else if (e.op == M61_TRACE_FREE) {
+            auto it = live.find(e.addr);
+            if (it == live.end()) {
+                // allocated before the ring starts, or a bad free
+                ++skipped;
+                continue;
+            }
+            start = now_ns();
+            do_free(it->second.ptr, e.site);
+            end = now_ns();
+            live_bytes -= it->second.size;
+            live.erase(it);
+        } else if (e.op == M61_TRACE_REALLOC) {
+            replay_block old = {nullptr, 0};
+            auto it = live.find(e.old_addr);
+            if (e.old_addr != 0 && it == live.end()) {
+                ++skipped;
+                continue;
+            }
+            if (e.old_addr != 0) {
+                old = it->second;
+            }
+            if (e.size != 0 && e.addr == 0) {
+                // failed when traced, the old block stays put
+                ++skipped;
+                continue;
+            }
+            start = now_ns();
+            void* ptr = do_realloc(old.ptr, e.size, e.site);
+            end = now_ns();
+            if (e.old_addr != 0) {
+                live_bytes -= old.size;
+                live.erase(e.old_addr);
+            }
+            if (e.size != 0) {
+                live[e.addr] = {ptr, e.size};
+                live_bytes += e.size;
+            }
+        } else {
+            // never filled in, the traced program died mid-call
+            ++skipped;
+            continue;
+        }
+        ++counts[e.op];
+        latency.push_back(end - start);
+        peak_bytes = std::max(peak_bytes, live_bytes);
+    }
+
+    fclose(f);
+
+    printf("replayed %zu of %llu events against %s, %llu skipped\n",
+           latency.size(), (unsigned long long) (th.next - first),
+           use_system ? "the system allocator" : "m61", skipped);
+    printf("calls: malloc %llu  free %llu  calloc %llu  realloc %llu\n",
+           counts[M61_TRACE_MALLOC], counts[M61_TRACE_FREE],
+           counts[M61_TRACE_CALLOC], counts[M61_TRACE_REALLOC]);
+    if (!latency.empty()) {
+        double sum = 0;
+        for (uint64_t ns : latency) {
+            sum += ns;
+        }
+        std::sort(latency.begin(), latency.end());
+        auto pct = [&] (double p) {
+            return (unsigned long long) latency[(size_t) (p * (latency.size() - 1))];
+        };
+        printf("latency ns: mean %.1f  p50 %llu  p99 %llu  p99.9 %llu  max %llu\n",
+               sum / latency.size(), pct(0.5), pct(0.99), pct(0.999),
+               (unsigned long long) latency.back());
+    }
+    rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    printf("peak live %zu bytes  peak rss %ld KiB  still live %zu blocks\n",
+           peak_bytes, ru.ru_maxrss, live.size());
+}
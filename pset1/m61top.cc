@@ -0,0 +1,156 @@
+#define M61_DISABLE 1
+#include "m61.hh"
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+// m61top: Watch the live statistics of a program running with M61_STATS.
+
+static uint64_t now_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void sleep_ms(unsigned ms) {
+    timespec ts = {(time_t) (ms / 1000), (long) (ms % 1000) * 1000000};
+    nanosleep(&ts, nullptr);
+}
+
+// Copy a consistent snapshot of `seg` into `out`. Only reads, so the
+// watched program never waits on us.
+static bool read_snapshot(const m61_stats_segment* seg, m61_stats_segment* out) {
+    for (int tries = 0; tries != 1000; ++tries) {
+        uint64_t before = __atomic_load_n(&seg->seq, __ATOMIC_ACQUIRE);
+        if (before % 2 == 0) {
+            memcpy(out, seg, sizeof(*out));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&seg->seq, __ATOMIC_RELAXED) == before) {
+                return true;
+            }
+        }
+        sleep_ms(0);
+    }
+    return false;
+}
+
+static void print_snapshot(const m61_stats_segment& s, const m61_stats_segment* prev) {
+    const m61_statistics& st = s.stats;
+    printf("pid %llu  update %llu  %.1fs old\n", (unsigned long long) s.pid,
+           (unsigned long long) s.updates, (now_ns() - s.time) / 1e9);
+    printf("active  %12llu blocks %14llu bytes\n", st.nactive, st.active_size);
+    printf("total   %12llu blocks %14llu bytes\n", st.ntotal, st.total_size);
+    printf("failed  %12llu blocks %14llu bytes\n", st.nfail, st.fail_size);
+    if (prev && s.time > prev->time) {
+        double dt = (s.time - prev->time) / 1e9;
+        printf("rate    %12.0f allocs/s %12.0f bytes/s   active %+.0f bytes/s\n",
+               (st.ntotal - prev->stats.ntotal) / dt,
+               (st.total_size - prev->stats.total_size) / dt,
+               ((double) st.active_size - (double) prev->stats.active_size) / dt);
+    }
+
+    printf("\n%-12s %12s %14s\n", "class", "live blocks", "live bytes");
+    for (unsigned i = 0; i != M61_STATS_CLASSES; ++i) {
+        if (s.class_blocks[i] == 0) {
+            continue;
+        }
+        char label[32];
+        if (i == M61_STATS_CLASSES - 2) {
+            strcpy(label, "large");
+        } else if (i == M61_STATS_CLASSES - 1) {
+            strcpy(label, "guard");
+        } else {
+            snprintf(label, sizeof(label), "<= %llu", (unsigned long long) s.class_size[i]);
+        }
+        printf("%-12s %12llu %14llu\n", label, (unsigned long long) s.class_blocks[i],
+               (unsigned long long) s.class_bytes[i]);
+    }
+
+    std::vector<unsigned> rows;
+    for (unsigned i = 0; i < s.nsites && i < M61_STATS_SITES; ++i) {
+        if (s.sites[i].live_bytes != 0) {
+            rows.push_back(i);
+        }
+    }
+    std::sort(rows.begin(), rows.end(), [&] (unsigned a, unsigned b) {
+        return s.sites[a].live_bytes > s.sites[b].live_bytes;
+    });
+    printf("\n%14s  %s\n", "live bytes", "site");
+    for (size_t i = 0; i < rows.size() && i < 10; ++i) {
+        const m61_stats_site& site = s.sites[rows[i]];
+        if (rows[i] == 0) {
+            printf("%14llu  %s\n", (unsigned long long) site.live_bytes, site.file);
+        } else {
+            printf("%14llu  %s:%lld\n", (unsigned long long) site.live_bytes, site.file,
+                   (long long) site.line);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    long count = -1;
+    unsigned interval = 1000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:i:")) != -1) {
+        if (opt == 'n') {
+            count = strtol(optarg, nullptr, 0);
+        } else if (opt == 'i') {
+            interval = strtoul(optarg, nullptr, 0);
+        } else {
+            optind = argc + 1;
+            break;
+        }
+    }
+    if (optind + 1 != argc) {
+        fprintf(stderr, "Usage: ./m61top [-n COUNT] [-i MS] FILE\n\
+\n\
+  Shows the statistics a program running with M61_STATS=FILE publishes:\n\
+  active and total allocations, live blocks by size class and live bytes\n\
+  by allocation site, every MS milliseconds (default 1000), COUNT times\n\
+  (default until interrupted). The program never waits on m61top.\n");
+        exit(1);
+    }
+
+    int fd = open(argv[optind], O_RDONLY);
+    void* mem = MAP_FAILED;
+    if (fd >= 0) {
+        mem = mmap(nullptr, sizeof(m61_stats_segment), PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+    }
+    const m61_stats_segment* seg = (const m61_stats_segment*) mem;
+    if (mem == MAP_FAILED
+        || memcmp(seg->magic, M61_STATS_MAGIC, sizeof(seg->magic)) != 0
+        || seg->version != M61_STATS_VERSION
+        || seg->segment_size != sizeof(m61_stats_segment)) {
+        fprintf(stderr, "m61top: %s: not an m61 statistics file\n", argv[optind]);
+        exit(1);
+    }
+
+    bool clear = isatty(STDOUT_FILENO);
+    m61_stats_segment* snap = new m61_stats_segment;
+    m61_stats_segment* prev = new m61_stats_segment;
+    bool have_prev = false;
+    for (long i = 0; count < 0 || i < count; ++i) {
+        if (i != 0) {
+            sleep_ms(interval);
+        }
+        if (!read_snapshot(seg, snap) || snap->updates == 0) {
+            printf("waiting for pid %llu to publish\n", (unsigned long long) seg->pid);
+            continue;
+        }
+        if (clear) {
+            printf("\033[H\033[J");
+        } else if (i != 0) {
+            printf("\n");
+        }
+        print_snapshot(*snap, have_prev ? prev : nullptr);
+        fflush(stdout);
+        std::swap(snap, prev);
+        have_prev = true;
+    }
+}
@@ -9,10 +9,10 @@ int main()
      void *ptr = malloc(2001);
      header *ptr_to_meta = (header *)((char *)ptr - sizeof(header));
      assert(ptr_to_meta->size == 2001);
-     assert(ptr_to_meta->is_active == 1337);
+     assert(ptr_to_meta->state == M61_ACTIVE);
      
      free(ptr);
-     assert(ptr_to_meta->is_active == 8008);
+     assert(ptr_to_meta->state == M61_FREED);
      
      //nullptr test
      //this should behave like malloc(sz, file, line)
@@ -27,10 +27,10 @@ int main()
      void* ptr_to_free = malloc(99);
      header* ptr_to_free_meta = (header*)((char*)ptr_to_free - sizeof(header));
      assert(ptr_to_free_meta->size == 99);
-     assert(ptr_to_free_meta->is_active == 1337);
+     assert(ptr_to_free_meta->state == M61_ACTIVE);
      void* result2 = realloc(ptr_to_free, 0);
      header *ptr_to_res2_meta = (header *)((char *)result2- sizeof(header));
-     assert(ptr_to_res2_meta->is_active == 8008);
+     assert(ptr_to_res2_meta->state == M61_FREED);
 
      //realloc from 5 to 10
      void* og = malloc(5);
@@ -39,8 +39,13 @@ int main()
      header *ptr_to_reog_meta = (header *)((char *)reog - sizeof(header));
      //new size should be 10
      assert(ptr_to_reog_meta->size == 10);
-     //should free old pointer
-     assert(ptr_to_og_meta->is_active == 8008);    
+     //there was room so it grew in place
+     assert(reog == og && ptr_to_og_meta->state == M61_ACTIVE);
+
+     //realloc from 10 to 100 doesn't fit, should free old pointer
+     void* moved = realloc(reog, 100);
+     assert(moved != reog);
+     assert(ptr_to_og_meta->state == M61_FREED);
     
     // m61_print_statistics();
     
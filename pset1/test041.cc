@@ -0,0 +1,24 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Wild free inside one of many live blocks.
+
+int main() {
+    const int nptrs = 100000;
+    static char* ptrs[nptrs];
+    for (int i = 0; i != nptrs; ++i) {
+        ptrs[i] = (char*) malloc(1 + i % 200);
+    }
+    free(ptrs[nptrs / 2 + 99] + 17);
+    for (int i = 0; i != nptrs; ++i) {
+        free(ptrs[i]);
+    }
+    m61_print_statistics();
+}
+
+//!!TIME
+//! MEMORY BUG: test???.cc:13: invalid free of pointer ???, not allocated
+//!   test???.cc:11: ??? is 17 bytes inside a 100 byte region allocated here
+//! alloc count: active          0   total     100000   fail          0
+//! alloc size:  active          0   total ??{\d+}??   fail          0
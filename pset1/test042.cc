@@ -0,0 +1,36 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Boundary write errors at size class edges.
+
+int main() {
+    size_t sizes[] = {15, 16, 23, 24, 4095, 32767, 32768};
+    for (size_t sz : sizes) {
+        char* ptr = (char*) malloc(sz);
+        char* ok = (char*) malloc(sz);
+        memset(ptr, 'x', sz + 1);
+        memset(ok, 'x', sz);
+        printf("size %zu\n", sz);
+        free(ptr);
+        free(ok);
+    }
+    m61_print_statistics();
+}
+
+//! size 15
+//! MEMORY BUG???: detected wild write during free of pointer ???
+//! size 16
+//! MEMORY BUG???: detected wild write during free of pointer ???
+//! size 23
+//! MEMORY BUG???: detected wild write during free of pointer ???
+//! size 24
+//! MEMORY BUG???: detected wild write during free of pointer ???
+//! size 4095
+//! MEMORY BUG???: detected wild write during free of pointer ???
+//! size 32767
+//! MEMORY BUG???: detected wild write during free of pointer ???
+//! size 32768
+//! MEMORY BUG???: detected wild write during free of pointer ???
+//! alloc count: active          7   total         14   fail          0
+//! alloc size:  active      69708   total     139416   fail          0
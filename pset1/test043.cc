@@ -0,0 +1,54 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <thread>
+// Allocation from many threads, with blocks freed by other threads.
+
+const int nthreads = 4;
+const int nptrs = 20000;
+static char* ptrs[nthreads][nptrs];
+static char* more[nthreads][nptrs];
+
+static void allocate(char* (&p)[nptrs], int t) {
+    for (int i = 0; i != nptrs; ++i) {
+        p[i] = (char*) malloc(1 + i % 100);
+        memset(p[i], t, 1 + i % 100);
+    }
+}
+
+static void release(int t) {
+    // free the blocks the next thread allocated
+    int victim = (t + 1) % nthreads;
+    for (int i = 0; i != nptrs; ++i) {
+        assert(ptrs[victim][i][0] == victim);
+        free(ptrs[victim][i]);
+    }
+    // and reuse them
+    allocate(more[t], t);
+}
+
+int main() {
+    std::thread th[nthreads];
+    for (int t = 0; t != nthreads; ++t) {
+        th[t] = std::thread([t] { allocate(ptrs[t], t); });
+    }
+    for (int t = 0; t != nthreads; ++t) {
+        th[t].join();
+    }
+    for (int t = 0; t != nthreads; ++t) {
+        th[t] = std::thread(release, t);
+    }
+    for (int t = 0; t != nthreads; ++t) {
+        th[t].join();
+    }
+    for (int t = 0; t != nthreads; ++t) {
+        for (int i = 0; i != nptrs; ++i) {
+            free(more[t][i]);
+        }
+    }
+    m61_print_statistics();
+}
+
+//! alloc count: active          0   total     160000   fail          0
+//! alloc size:  active          0   total    8080000   fail          0
@@ -0,0 +1,23 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Heavy hitter report with many more sites than the report tracks.
+
+int main() {
+    // 5000 light sites, 10 bytes each per round
+    // and one heavy site getting as many bytes as all of them together
+    for (int round = 0; round != 20; ++round) {
+        for (int line = 1000; line != 6000; ++line) {
+            m61_free(m61_malloc(10, "light.cc", line), "light.cc", line);
+        }
+        for (int i = 0; i != 50; ++i) {
+            free(malloc(1000));
+        }
+    }
+    m61_print_heavy_hitter_report();
+}
+
+//! total_size called: 2000000 bytes in 101000 allocations
+//! HEAVY HITTER: test???.cc:15: ??{10[0-3]\d{4}}?? bytes(~5???%)
+//! ???
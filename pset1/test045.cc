@@ -0,0 +1,35 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Allocation sites are interned into small ids.
+
+int main() {
+    unsigned a = m61_site_id("a.cc", 10);
+    unsigned b = m61_site_id("b.cc", 10);
+    unsigned a2 = m61_site_id("a.cc", 11);
+    assert(a != 0 && b != 0 && a2 != 0);
+    assert(a != b && a != a2 && b != a2);
+    assert(m61_site_id("a.cc", 10) == a);
+
+    // lots of sites still come back the same
+    static char name[] = "many.cc";
+    for (long line = 0; line != 100000; ++line) {
+        unsigned id = m61_site_id(name, line);
+        assert(id == m61_site_id(name, line));
+    }
+    assert(m61_site_id("a.cc", 10) == a);
+
+    const char* file;
+    long line;
+    m61_site_location(a2, &file, &line);
+    printf("%u %s:%ld\n", a2 - a, file, line);
+    m61_site_location(m61_site_id(name, 4321), &file, &line);
+    printf("%s:%ld\n", file, line);
+    m61_site_location(1000000000, &file, &line);
+    printf("%s:%ld\n", file, line);
+}
+
+//! 2 a.cc:11
+//! many.cc:4321
+//! ?:0
@@ -0,0 +1,17 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Boundary write errors off the front of a block damage its header.
+
+int main() {
+    char* ptr = (char*) malloc(64);
+    fprintf(stderr, "Will free %p\n", ptr);
+    ptr[-1] ^= 1;
+    free(ptr);
+    m61_print_statistics();
+}
+
+//! Will free ??{0x\w+}=ptr??
+//! MEMORY BUG???: detected wild write during free of pointer ??ptr??
+//! ???
@@ -0,0 +1,36 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Realloc grows and shrinks in place when it can.
+
+int main() {
+    // grow a buffer one byte at a time
+    char* buf = nullptr;
+    int moves = 0;
+    for (int n = 1; n <= 1000000; ++n) {
+        char* next = (char*) realloc(buf, n);
+        assert(next);
+        if (next != buf) {
+            ++moves;
+        }
+        buf = next;
+        buf[n - 1] = (char) n;
+    }
+    for (int n = 1; n <= 1000000; ++n) {
+        assert(buf[n - 1] == (char) n);
+    }
+    printf("moves %s\n", moves < 100 ? "few" : "many");
+
+    // shrinking a little stays put, and the trailer moves with it
+    char* small = (char*) realloc(buf, 900000);
+    assert(small == buf);
+    small[900000] = 0;
+    free(small);
+    m61_print_statistics();
+}
+
+//! moves few
+//! MEMORY BUG???: detected wild write during free of pointer ???
+//! alloc count: active          1   total    1000001   fail          0
+//! alloc size:  active     900000   total ??{\d+}??   fail          0
@@ -0,0 +1,48 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <unistd.h>
+#include <cstdint>
+// In guard mode an overflow faults right away, at the guard page.
+
+int main() {
+    // the fault report goes to stderr
+    dup2(STDOUT_FILENO, STDERR_FILENO);
+    setenv("M61_GUARD", "1", 1);
+
+    // every block ends at most 7 bytes short of a page boundary
+    for (size_t sz : {0, 1, 13, 64, 100, 4000, 4096, 70000}) {
+        char* p = (char*) malloc(sz);
+        assert(p && (uintptr_t) p % 8 == 0);
+        assert(((uintptr_t) p + sz + 7) / 8 * 8 % 4096 == 0);
+        memset(p, 'x', sz);
+        free(p);
+    }
+
+    // realloc still copies
+    char* s = (char*) malloc(5);
+    memcpy(s, "abcd", 5);
+    s = (char*) realloc(s, 4000);
+    assert(strcmp(s, "abcd") == 0);
+    free(s);
+    m61_print_statistics();
+
+    // the slack before the guard page is checked on free
+    char* odd = (char*) malloc(13);
+    odd[14] = 'x';
+    free(odd);
+
+    char* ptr = (char*) malloc(24);
+    printf("Will write past %p\n", ptr);
+    for (int i = 0; i <= 24; ++i) {
+        ptr[i] = 'A';
+    }
+    printf("Not reached\n");
+}
+
+//! alloc count: active          0   total         10   fail          0
+//! alloc size:  active          0   total ??{\d+}??   fail          0
+//! MEMORY BUG: test048.cc:34: detected wild write during free of pointer ??{0x\w+}??
+//! Will write past ??{0x\w+}=ptr??
+//! MEMORY BUG: test048.cc:36: access to ??{0x\w+}?? is 0 bytes past the end of a 24 byte region allocated here
@@ -0,0 +1,38 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <unistd.h>
+// In guard mode freed blocks are quarantined: a double free is still
+// caught, and touching freed memory faults.
+
+int main() {
+    // the fault report goes to stderr
+    dup2(STDOUT_FILENO, STDERR_FILENO);
+    setenv("M61_GUARD", "1", 1);
+    setenv("M61_GUARD_QUARANTINE", "65536", 1);
+
+    char* ptr = (char*) malloc(100);
+    free(ptr);
+    free(ptr);
+
+    // push lots of blocks through the quarantine, old runs get reused
+    for (int i = 0; i < 10000; ++i) {
+        char* p = (char*) malloc(i % 3000);
+        memset(p, 0, i % 3000);
+        free(p);
+    }
+    m61_print_statistics();
+
+    char* q = (char*) malloc(200);
+    free(q);
+    printf("Will read %p\n", q);
+    printf("%d\n", q[5]);
+    printf("Not reached\n");
+}
+
+//! MEMORY BUG???: invalid free of pointer ??{0x\w+}=ptr??, double free
+//! alloc count: active          0   total      10001   fail          0
+//! alloc size:  active          0   total ??{\d+}??   fail          0
+//! Will read ??{0x\w+}=q??
+//! MEMORY BUG: access to ??{0x\w+}?? inside freed block ??q??
@@ -0,0 +1,35 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// With M61_CANARY, overruns that skip the byte right after the payload are
+// still caught, on free or by m61_check_heap.
+
+int main() {
+    setenv("M61_CANARY", "16", 1);
+
+    // realloc in place keeps the canaries right
+    char* c = (char*) malloc(100);
+    c = (char*) realloc(c, 90);
+    memset(c, 0, 90);
+    char* d = (char*) malloc(3000);
+    printf("damaged %d\n", m61_check_heap());
+
+    d[3000 + 15] = 'x';
+    printf("damaged %d\n", m61_check_heap());
+    free(c);
+
+    char* a = (char*) malloc(40);
+    a[45] = 'x';
+    free(a);
+
+    char* b = (char*) malloc(40);
+    b[-3] = 'x';
+    free(b);
+}
+
+//! damaged 0
+//! MEMORY BUG: test050.cc:15: heap check detected wild write around pointer ??{0x\w+}?? allocated here
+//! damaged 1
+//! MEMORY BUG: test050.cc:24: detected wild write during free of pointer ??{0x\w+}??
+//! MEMORY BUG: test050.cc:28: detected wild write during free of pointer ??{0x\w+}??
@@ -0,0 +1,23 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <thread>
+#include <chrono>
+// M61_CHECK_INTERVAL checks the heap in the background.
+
+int main() {
+    setenv("M61_CANARY", "8", 1);
+    setenv("M61_CHECK_INTERVAL", "5", 1);
+
+    char* ptrs[100];
+    for (int i = 0; i != 100; ++i) {
+        ptrs[i] = (char*) malloc(i * 10);
+    }
+    ptrs[50][-8] = 0;
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    printf("done\n");
+}
+
+//! MEMORY BUG: test051.cc:15: heap check detected wild write around pointer ??{0x\w+}?? allocated here
+//! done
@@ -0,0 +1,57 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <unistd.h>
+// M61_TRACE logs every call to a ring of events in a file.
+
+int main() {
+    char path[] = "/tmp/m61traceXXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+    setenv("M61_TRACE", path, 1);
+    setenv("M61_TRACE_EVENTS", "4", 1);
+
+    char* p = (char*) malloc(10);
+    char* q = (char*) calloc(3, 4);
+    char* q2 = (char*) realloc(q, 100);
+    free(p);
+    free(q2);
+    char* r = (char*) malloc(7);
+
+    // the ring only has room for the last 4
+    FILE* f = fopen(path, "rb");
+    m61_trace_header th;
+    m61_trace_event ev[4];
+    assert(fread(&th, sizeof(th), 1, f) == 1);
+    assert(fread(ev, sizeof(m61_trace_event), 4, f) == 4);
+    fclose(f);
+    unlink(path);
+    assert(memcmp(th.magic, M61_TRACE_MAGIC, 8) == 0);
+    printf("capacity %llu next %llu\n", (unsigned long long) th.capacity,
+           (unsigned long long) th.next);
+    for (uint64_t i = th.next - th.capacity; i < th.next; ++i) {
+        m61_trace_event& e = ev[i % th.capacity];
+        const char* file;
+        long line;
+        m61_site_location(e.site, &file, &line);
+        printf("op %u size %llu line %ld thread %u", e.op,
+               (unsigned long long) e.size, line, e.thread);
+        if (e.addr) {
+            printf(" addr %s", e.addr == (uintptr_t) q2 ? "q2"
+                   : e.addr == (uintptr_t) p ? "p" : e.addr == (uintptr_t) r ? "r" : "?");
+        }
+        if (e.old_addr) {
+            printf(" old %s", e.old_addr == (uintptr_t) q ? "q" : "?");
+        }
+        printf("\n");
+        assert(i == th.next - th.capacity || e.time >= ev[(i - 1) % th.capacity].time);
+    }
+}
+
+//! capacity 4 next 6
+//! op 4 size 100 line 18 thread 0 addr q2 old q
+//! op 2 size 0 line 19 thread 0 addr p
+//! op 2 size 0 line 20 thread 0 addr q2
+//! op 1 size 7 line 21 thread 0 addr r
@@ -0,0 +1,57 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <unistd.h>
+// Big calloc takes pages that are already zero and doesn't touch them.
+
+static size_t rss_pages() {
+    FILE* f = fopen("/proc/self/statm", "r");
+    size_t size, resident;
+    assert(fscanf(f, "%zu %zu", &size, &resident) == 2);
+    fclose(f);
+    return resident;
+}
+
+static bool all_zero(const char* p, size_t n) {
+    for (size_t i = 0; i != n; ++i) {
+        if (p[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    const size_t big = 64 << 20;
+    free(malloc(1));
+    size_t before = rss_pages();
+    char* a = (char*) calloc(big / 8, 8);
+    assert(a);
+    // only the header and trailer pages are touched, plus the page map
+    // (memset would have touched all 16384)
+    assert(rss_pages() - before < 256);
+    assert(a[0] == 0 && a[big / 2] == 0 && a[big - 1] == 0);
+
+    // a freed mapping is reused, and reads as zero again
+    memset(a, 'x', big);
+    free(a);
+    char* b = (char*) calloc(1, big - 100);
+    assert(all_zero(b, big - 100));
+
+    // smaller blocks get zeroed the ordinary way
+    char* c = (char*) malloc(100000);
+    memset(c, 'y', 100000);
+    free(c);
+    char* d = (char*) calloc(100000, 1);
+    assert(all_zero(d, 100000));
+
+    free(d);
+    free(b);
+    free(b);
+    m61_print_statistics();
+}
+
+//! MEMORY BUG: test053.cc:51: invalid free of pointer ??{0x\w+}??, double free
+//! alloc count: active          0   total          5   fail          0
+//! alloc size:  active          0   total  134417629   fail          0
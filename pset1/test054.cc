@@ -0,0 +1,37 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <vector>
+// M61_SAMPLE tracks sites for a sample of the bytes and scales it back up.
+
+int main() {
+    setenv("M61_SAMPLE", "4096", 1);
+
+    std::vector<void*> a, b;
+    for (int i = 0; i != 40000; ++i) {
+        a.push_back(malloc(100));
+    }
+    for (int i = 0; i != 250; ++i) {
+        b.push_back(malloc(4000));
+    }
+    m61_print_leak_report();
+
+    for (void* p : a) {
+        free(p);
+    }
+    for (void* p : b) {
+        free(p);
+    }
+    m61_print_heavy_hitter_report();
+    m61_print_statistics();
+}
+
+// estimates are within ~5 standard deviations
+//! LEAK CHECK: test054.cc:13: ~??{(3[4-9]|4[0-6])\d{5}}?? bytes in ~??{(3[4-9]|4[0-6])\d{3}}?? objects (??{\d+}?? sampled)
+//! LEAK CHECK: test054.cc:16: ~??{(6\d|[7-9]\d|1[0-3]\d)\d{4}}?? bytes in ~??{1\d\d|2\d\d|3[0-2]\d}?? objects (??{\d+}?? sampled)
+//! total_size called: 5000000 bytes in 40250 allocations
+//! HEAVY HITTER: test054.cc:13: ??{(3[4-9]|4[0-6])\d{5}}?? bytes(~??{[6-9]\d\.\d\d}??%)
+//! HEAVY HITTER: test054.cc:16: ??{(6\d|[7-9]\d|1[0-3]\d)\d{4}}?? bytes(~??{(1[2-9]|2[0-7])\.\d\d}??%)
+//! alloc count: active          0   total      40250   fail          0
+//! alloc size:  active          0   total    5000000   fail          0
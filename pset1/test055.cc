@@ -0,0 +1,79 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+// M61_STATS publishes live statistics to a file for m61top.
+
+int main() {
+    char path[] = "/tmp/m61statsXXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+    setenv("M61_STATS", path, 1);
+    setenv("M61_STATS_INTERVAL", "1", 1);
+
+    void* p[10];
+    for (int i = 0; i != 10; ++i) {
+        p[i] = malloc(100);
+    }
+    void* big = malloc(100000);
+    free(p[0]);
+
+    fd = open(path, O_RDONLY);
+    auto seg = (const m61_stats_segment*) mmap(nullptr, sizeof(m61_stats_segment),
+                                               PROT_READ, MAP_SHARED, fd, 0);
+    assert(seg != MAP_FAILED);
+    close(fd);
+    unlink(path);
+    assert(memcmp(seg->magic, M61_STATS_MAGIC, 8) == 0);
+    assert(seg->pid == (uint64_t) getpid());
+
+    // wait for an update that started after our frees, then take a
+    // seqlock snapshot
+    uint64_t start = __atomic_load_n(&seg->updates, __ATOMIC_ACQUIRE);
+    static m61_stats_segment s;
+    for (int tries = 0; ; ++tries) {
+        assert(tries < 5000);
+        uint64_t seq = __atomic_load_n(&seg->seq, __ATOMIC_ACQUIRE);
+        if (seq % 2 == 0) {
+            memcpy(&s, seg, sizeof(s));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&seg->seq, __ATOMIC_RELAXED) == seq
+                && s.updates >= start + 2) {
+                break;
+            }
+        }
+        usleep(1000);
+    }
+
+    printf("active %llu blocks %llu bytes\n", s.stats.nactive, s.stats.active_size);
+    for (unsigned i = 0; i != M61_STATS_CLASSES; ++i) {
+        if (s.class_blocks[i]) {
+            printf("class %u: room %llu, %llu blocks %llu bytes\n", i,
+                   (unsigned long long) s.class_size[i],
+                   (unsigned long long) s.class_blocks[i],
+                   (unsigned long long) s.class_bytes[i]);
+        }
+    }
+    for (unsigned i = 0; i != s.nsites; ++i) {
+        if (s.sites[i].live_bytes) {
+            printf("site %s:%lld: %llu bytes\n", s.sites[i].file,
+                   (long long) s.sites[i].line,
+                   (unsigned long long) s.sites[i].live_bytes);
+        }
+    }
+
+    for (int i = 1; i != 10; ++i) {
+        free(p[i]);
+    }
+    free(big);
+}
+
+//! active 10 blocks 100900 bytes
+//! class 6: room 128, 9 blocks 900 bytes
+//! class 23: room 0, 1 blocks 100000 bytes
+//! site test055.cc:20: 900 bytes
+//! site test055.cc:22: 100000 bytes
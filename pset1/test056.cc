@@ -0,0 +1,50 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// m61_get_histograms buckets sizes and lifetimes by log2 and tracks live
+// bytes per site.
+
+int main() {
+    void* a = malloc(0);
+    void* b = malloc(1);
+    void* c = malloc(100);
+    void* d = malloc(4096);
+    free(a);                        // lived 3 allocations
+    void* e = malloc(8);
+    free(e);                        // lived 0
+    for (int i = 0; i != 20; ++i) {
+        free(malloc(20));           // 0 each
+    }
+    free(b);                        // 23
+
+    m61_histograms h;
+    m61_get_histograms(&h);
+    for (int i = 0; i != M61_HIST_BUCKETS; ++i) {
+        if (h.size[i]) {
+            printf("size bucket %d: %llu\n", i, h.size[i]);
+        }
+    }
+    for (int i = 0; i != M61_HIST_BUCKETS; ++i) {
+        if (h.lifetime[i]) {
+            printf("lifetime bucket %d: %llu\n", i, h.lifetime[i]);
+        }
+    }
+    printf("site live: %llu %llu %llu\n",
+           h.site_live[m61_site_id("test056.cc", 10)],
+           h.site_live[m61_site_id("test056.cc", 11)],
+           h.site_live[m61_site_id("test056.cc", 12)]);
+    free(c);
+    free(d);
+}
+
+//! size bucket 0: 1
+//! size bucket 1: 1
+//! size bucket 4: 1
+//! size bucket 5: 20
+//! size bucket 7: 1
+//! size bucket 13: 1
+//! lifetime bucket 0: 21
+//! lifetime bucket 2: 1
+//! lifetime bucket 5: 1
+//! site live: 0 100 4096
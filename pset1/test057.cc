@@ -0,0 +1,43 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Arena objects are bump allocated, counted under the arena's site and
+// freed all at once.
+
+int main() {
+    m61_arena* a = m61_arena_create(__FILE__, __LINE__);
+    m61_arena* b = m61_arena_create(__FILE__, __LINE__);
+    char* prev = nullptr;
+    for (int i = 0; i != 10000; ++i) {
+        char* p = (char*) m61_arena_alloc(a, 24);
+        assert(p && (uintptr_t) p % 16 == 0 && p != prev);
+        memset(p, 'x', 24);
+        prev = p;
+    }
+    char* big = (char*) m61_arena_alloc(a, 1 << 20);
+    assert(big && (uintptr_t) big % 16 == 0);
+    memset(big, 'y', 1 << 20);
+    assert(m61_arena_alloc(a, 0) != m61_arena_alloc(a, 0));
+    m61_arena_alloc(b, 100);
+
+    m61_statistics stat;
+    m61_get_statistics(&stat);
+    printf("active %llu %llu\n", stat.nactive, stat.active_size);
+    free(prev);
+    m61_print_leak_report();
+
+    m61_arena_destroy(a, __FILE__, __LINE__);
+    m61_get_statistics(&stat);
+    printf("active %llu %llu total %llu %llu\n", stat.nactive, stat.active_size,
+           stat.ntotal, stat.total_size);
+    m61_print_leak_report();
+}
+
+//! active 10004 1288676
+//! MEMORY BUG: test???.cc:27: invalid free of pointer ??{\w+}??, not allocated
+//! ???
+//! LEAK CHECK: test???.cc:10: allocated arena ??{\w+}?? with 1 objects of 100 bytes
+//! LEAK CHECK: test???.cc:9: allocated arena ??{\w+}?? with 10003 objects of 1288576 bytes
+//! active 1 100 total 10004 1288676
+//! LEAK CHECK: test???.cc:10: allocated arena ??{\w+}?? with 1 objects of 100 bytes
@@ -0,0 +1,52 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <list>
+// A stateful m61_allocator carries a site and an arena, and containers
+// carry it along.
+
+int main() {
+    using intlist = std::list<int, m61_allocator<int>>;
+    m61_arena* arena = m61_arena_create(__FILE__, __LINE__);
+    m61_allocator<int> pooled(arena, __FILE__, __LINE__);
+    m61_allocator<int> here(__FILE__, __LINE__);
+
+    // list nodes rebind the allocator and come out of the arena
+    intlist a(pooled);
+    for (int i = 0; i != 1000; ++i) {
+        a.push_back(i);
+    }
+    assert(a.get_allocator().arena() == arena);
+
+    // swap and move assignment take the arena along
+    intlist b(here);
+    b.push_back(-1);
+    a.swap(b);
+    assert(a.get_allocator().arena() == nullptr && b.get_allocator().arena() == arena);
+    intlist c;
+    c = std::move(b);
+    assert(c.get_allocator().arena() == arena && c.size() == 1000);
+    intlist d(here);
+    d = c;
+    assert(d.get_allocator().arena() == arena && d.size() == 1000);
+
+    // allocate_at_least hands out the whole block
+    m61_allocation_result<char> r = m61_allocator<char>(here).allocate_at_least(100);
+    assert(r.ptr && r.count >= 100);
+    memset(r.ptr, 'x', r.count);
+    m61_allocator<char>().deallocate(r.ptr, r.count);
+
+    here.allocate(10);
+    d.clear();
+    c.clear();
+    a.clear();
+    m61_print_leak_report();
+    m61_arena_destroy(arena, __FILE__, __LINE__);
+    m61_print_leak_report();
+}
+
+//!!UNORDERED
+//! LEAK CHECK: test???.cc:11: allocated arena ??{\w+}?? with 2000 objects of 48000 bytes
+//! LEAK CHECK: test???.cc:13: allocated object ??{\w+}?? with size 40
+//! LEAK CHECK: test???.cc:13: allocated object ??{\w+}?? with size 40
@@ -0,0 +1,28 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// M61_LEAKS=site groups the leak report by site, biggest first.
+
+int main() {
+    setenv("M61_LEAKS", "site", 1);
+    for (int i = 0; i != 1000; ++i) {
+        malloc(10);
+    }
+    for (int i = 0; i != 3; ++i) {
+        malloc(5000);
+    }
+    void* p = malloc(1);
+    free(malloc(100));
+    m61_arena* arena = m61_arena_create(__FILE__, __LINE__);
+    for (int i = 0; i != 100; ++i) {
+        m61_arena_alloc(arena, 7);
+    }
+    m61_print_leak_report();
+    (void) p;
+}
+
+//! LEAK CHECK: test???.cc:13: 15000 bytes in 3 objects
+//! LEAK CHECK: test???.cc:10: 10000 bytes in 1000 objects
+//! LEAK CHECK: test???.cc:17: 700 bytes in 100 objects
+//! LEAK CHECK: test???.cc:15: 1 bytes in 1 object
@@ -0,0 +1,46 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// M61_LEAKS=stack also tells apart the backtraces that led to a site.
+
+// storing the result after each call keeps these from being tail calls,
+// which would drop them from the backtrace
+void* last[3];
+
+__attribute__((noinline)) void* make(size_t sz) {
+    last[0] = malloc(sz);
+    return last[0];
+}
+
+__attribute__((noinline)) void* from_a(size_t sz) {
+    last[1] = make(sz);
+    return last[1];
+}
+
+__attribute__((noinline)) void* from_b(size_t sz) {
+    last[2] = make(sz);
+    return last[2];
+}
+
+int main() {
+    setenv("M61_LEAKS", "stack", 1);
+    for (int i = 0; i != 10; ++i) {
+        from_a(100);
+    }
+    for (int i = 0; i != 20; ++i) {
+        from_b(10);
+    }
+    m61_print_leak_report();
+}
+
+//! LEAK CHECK: test???.cc:12: 1000 bytes in 10 objects
+//! ??{    #0 .*}??
+//! ??{    #1 .*}??
+//! ??{    #2 .*}??
+//! ???
+//! LEAK CHECK: test???.cc:12: 200 bytes in 20 objects
+//! ??{    #0 .*}??
+//! ??{    #1 .*}??
+//! ??{    #2 .*}??
+//! ???
@@ -0,0 +1,42 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// m61_block_info finds the block any pointer falls in; m61_owns says
+// whether it's in an active block's payload.
+
+int main() {
+    char* a = (char*) malloc(100);
+    char* big = (char*) malloc(1 << 20);
+    char* z = (char*) malloc(0);
+    char* gone = (char*) malloc(50);
+    free(gone);
+
+    m61_block info;
+    assert(m61_block_info(a + 37, &info));
+    printf("%s:%ld: %zu %s %d\n", info.file, info.line, info.size,
+           info.state == M61_ACTIVE ? "active" : "freed", info.base == a);
+    assert(m61_block_info(big + 999999, &info));
+    printf("%s:%ld: %zu %s %d\n", info.file, info.line, info.size,
+           info.state == M61_ACTIVE ? "active" : "freed", info.base == big);
+    assert(m61_block_info(gone + 10, &info));
+    printf("%s:%ld: %zu %s %d\n", info.file, info.line, info.size,
+           info.state == M61_ACTIVE ? "active" : "freed", info.base == gone);
+    assert(m61_block_info(a - 1, &info) && info.base == a);
+
+    int local;
+    assert(!m61_block_info(&local, &info));
+    assert(!m61_owns(&local) && !m61_owns(nullptr));
+    assert(m61_owns(a) && m61_owns(a + 99) && !m61_owns(a + 100) && !m61_owns(a - 1));
+    assert(m61_owns(big + (1 << 20) - 1));
+    assert(m61_owns(z));
+    assert(!m61_owns(gone));
+    free(a);
+    assert(!m61_owns(a));
+    free(big);
+    free(z);
+}
+
+//! test???.cc:9: 100 active 1
+//! test???.cc:10: 1048576 active 1
+//! test???.cc:12: 50 freed 1
@@ -0,0 +1,44 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// m61_malloc_batch and m61_free_batch act like loops of malloc and free.
+
+int main() {
+    void* small[1000];
+    void* big[4];
+    assert(m61_malloc_batch(1000, 24, small, __FILE__, __LINE__) == 1000);
+    assert(m61_malloc_batch(4, 100000, big, __FILE__, __LINE__) == 4);
+    for (int i = 0; i != 1000; ++i) {
+        assert(small[i] && (uintptr_t) small[i] % 8 == 0);
+        memset(small[i], i, 24);
+    }
+    for (int i = 1; i != 1000; ++i) {
+        assert(small[i] != small[i - 1]);
+    }
+    m61_print_statistics();
+
+    void* mixed[] = {small[0], nullptr, big[0], small[1], big[1], small[0]};
+    m61_free_batch(mixed, 6, __FILE__, __LINE__);
+    m61_free_batch(small + 2, 998, __FILE__, __LINE__);
+    m61_free_batch(big + 2, 2, __FILE__, __LINE__);
+    m61_print_statistics();
+
+    // freed slots come back
+    void* again[1000];
+    assert(m61_malloc_batch(1000, 24, again, __FILE__, __LINE__) == 1000);
+    m61_free_batch(again, 1000, __FILE__, __LINE__);
+
+    // a failed large batch counts one failure
+    assert(m61_malloc_batch(4, (size_t) 1 << 48, big, __FILE__, __LINE__) == 0);
+    m61_print_statistics();
+    m61_print_leak_report();
+}
+
+//! alloc count: active       1004   total       1004   fail          0
+//! alloc size:  active     424000   total     424000   fail          0
+//! MEMORY BUG: test???.cc:22: invalid free of pointer ??{\w+}??, double free
+//! alloc count: active          0   total       1004   fail          0
+//! alloc size:  active          0   total     424000   fail          0
+//! alloc count: active          0   total       2004   fail          1
+//! alloc size:  active          0   total     448000   fail 281474976710656
@@ -0,0 +1,36 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// m61_aligned_alloc hands out aligned blocks that free, realloc and the
+// leak report treat like any other.
+
+int main() {
+    void* ptrs[64];
+    int n = 0;
+    for (size_t align = 1; align <= 8192; align *= 2) {
+        for (size_t sz : {1, 24, 100, 5000}) {
+            char* p = (char*) aligned_alloc(align, sz);
+            assert(p && (uintptr_t) p % align == 0);
+            memset(p, 'a', sz);
+            ptrs[n++] = p;
+        }
+    }
+    assert(m61_memalign(3, 10, __FILE__, __LINE__) == nullptr);
+    assert(m61_owns(ptrs[5]));
+
+    char* r = (char*) realloc(ptrs[0], 200);
+    assert(r && r[0] == 'a');
+    ptrs[0] = r;
+    for (int i = 1; i != n; ++i) {
+        free(ptrs[i]);
+    }
+    free(ptrs[7]);
+    m61_print_statistics();
+    m61_print_leak_report();
+}
+
+//! MEMORY BUG: test???.cc:28: invalid free of pointer ??{\w+}??, double free
+//! alloc count: active          1   total         57   fail          1
+//! alloc size:  active        200   total  ??>=1??   fail         10
+//! LEAK CHECK: test???.cc:22: allocated object ??{\w+}?? with size 200
@@ -0,0 +1,40 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+// M61_CACHELINE gives every payload cache lines of its own.
+
+int main() {
+    setenv("M61_CACHELINE", "1", 1);
+    std::vector<char*> ptrs;
+    for (size_t sz = 0; sz != 300; ++sz) {
+        for (int i = 0; i != 3; ++i) {
+            char* p = (char*) malloc(sz);
+            assert((uintptr_t) p % 64 == 0);
+            memset(p, 'x', sz);
+            ptrs.push_back(p);
+        }
+    }
+    ptrs.push_back((char*) malloc(100000));
+    assert((uintptr_t) ptrs.back() % 64 == 0);
+
+    // no two payloads touch the same line
+    std::vector<std::pair<uintptr_t, uintptr_t>> lines;
+    for (size_t i = 0; i != ptrs.size(); ++i) {
+        uintptr_t first = (uintptr_t) ptrs[i] / 64;
+        lines.push_back({first, first + (i / 3 == 0 ? 0 : (i / 3 - 1) / 64)});
+    }
+    std::sort(lines.begin(), lines.end());
+    for (size_t i = 1; i != lines.size(); ++i) {
+        assert(lines[i].first > lines[i - 1].second);
+    }
+    for (char* p : ptrs) {
+        free(p);
+    }
+    m61_print_statistics();
+}
+
+//! alloc count: active          0   total        901   fail          0
+//! alloc size:  active          0   total     234550   fail          0
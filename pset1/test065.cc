@@ -0,0 +1,33 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <unistd.h>
+// Freed big calloc mappings are only kept up to a cap, so callocs of ever
+// growing sizes, which never fit a kept one, don't pile up address space.
+
+static size_t mapped_pages() {
+    FILE* f = fopen("/proc/self/statm", "r");
+    size_t size;
+    assert(fscanf(f, "%zu", &size) == 1);
+    fclose(f);
+    return size;
+}
+
+int main() {
+    const size_t mb = 1 << 20;
+    free(malloc(1));
+    size_t before = mapped_pages();
+    for (size_t i = 1; i <= 200; ++i) {
+        char* p = (char*) calloc(i, mb);
+        assert(p && p[0] == 0 && p[i * mb - 1] == 0);
+        p[i * mb / 2] = 1;
+        free(p);
+    }
+    // 20 GiB went by; what's left is the parked spans, at most 256 MiB
+    assert((mapped_pages() - before) * 4096 < 300 * mb);
+    m61_print_statistics();
+}
+
+//! alloc count: active          0   total        201   fail          0
+//! alloc size:  active          0   total ??{\d+}??   fail          0
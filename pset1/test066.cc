@@ -0,0 +1,27 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <sys/mman.h>
+// Freeing a pointer between the heap's lowest and highest blocks that
+// points at unmapped memory is reported, not a crash.
+
+int main() {
+    // a small block and a big calloc, which gets its own mmap, so the
+    // heap's range spans the gap between the two
+    char* a = (char*) malloc(10);
+    char* b = (char*) calloc(1, 1 << 20);
+    uintptr_t lo = (uintptr_t) (a < b ? a : b), hi = (uintptr_t) (a < b ? b : a);
+    char* hole = (char*) (((lo + hi) / 2) & ~(uintptr_t) 4095);
+    unsigned char vec;
+    assert(mincore(hole, 4096, &vec) == -1 && errno == ENOMEM);
+    free(hole + 64);
+    free(a);
+    free(b);
+    m61_print_statistics();
+}
+
+//! MEMORY BUG: test066.cc:19: invalid free of pointer ??{0x\w+}??, not allocated
+//! alloc count: active          0   total          2   fail          0
+//! alloc size:  active          0   total    1048586   fail          0
@@ -0,0 +1,23 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Destroying an arena whose chunk was overrun reports the wild write, and
+// the leak report afterwards lists the chunk as a plain block rather than
+// reading the destroyed arena.
+
+int main() {
+    m61_arena* a = m61_arena_create(__FILE__, __LINE__);
+    m61_arena* b = m61_arena_create(__FILE__, __LINE__);
+    char* p = (char*) m61_arena_alloc(a, 1 << 20);
+    assert(p);
+    memset(p, 'x', (1 << 20) + 8);
+    m61_arena_alloc(b, 100);
+    m61_arena_destroy(a, __FILE__, __LINE__);
+    m61_print_leak_report();
+}
+
+//!!UNORDERED
+//! MEMORY BUG: test067.cc:16: detected wild write during destroy of arena ??{0x\w+}??
+//! LEAK CHECK: test067.cc:11: allocated arena ??{0x\w+}?? with 1 objects of 100 bytes
+//! LEAK CHECK: test067.cc:10: allocated object ??{0x\w+}?? with size ??{\d+}??
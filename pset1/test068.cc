@@ -0,0 +1,23 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Arena objects stay 16 byte aligned when the canary isn't a multiple of 16.
+
+int main() {
+    setenv("M61_CANARY", "24", 1);
+    m61_arena* a = m61_arena_create(__FILE__, __LINE__);
+    for (int i = 0; i != 10000; ++i) {
+        char* p = (char*) m61_arena_alloc(a, 40);
+        assert(p && (uintptr_t) p % 16 == 0);
+        memset(p, 'x', 40);
+    }
+    char* big = (char*) m61_arena_alloc(a, 1 << 20);
+    assert(big && (uintptr_t) big % 16 == 0);
+    memset(big, 'y', 1 << 20);
+    m61_arena_destroy(a, __FILE__, __LINE__);
+    m61_print_statistics();
+}
+
+//! alloc count: active          0   total      10001   fail          0
+//! alloc size:  active          0   total    1448576   fail          0
@@ -1,26 +1,97 @@
 #include "io61.hh"
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <poll.h>
 #include <climits>
 #include <cerrno>
 
 // io61.c
 //    YOUR CODE HERE!
 
+// cache geometry: IO61_SLOTS slots of IO61_SLOT_SIZE bytes per file, which
+// the IO61_SLOTS and IO61_SLOT_SIZE environment variables override
+#define IO61_SLOTS 128
+#define IO61_SLOT_SIZE 4096
+#define IO61_PAGE_SIZE 4096
+
+// read-ahead: a patterned miss reads up to IO61_READAHEAD_MAX blocks (and
+// at most an eighth of the slots) spanning under IO61_READAHEAD_SPAN bytes;
+// the gaps of a strided read land in a IO61_SCRATCH_SIZE byte sink
+#define IO61_READAHEAD_MAX 32
+#define IO61_READAHEAD_SPAN (1 << 20)
+#define IO61_SCRATCH_SIZE (64 << 10)
+#define IO61_MAX_IOV 128
+
+// number of recently current slots checked before all of them
+#define IO61_RECENT 8
+
+// io61_slot
+//    One cache slot: bytes [tag, end_tag) of the file. An empty slot has
+//    tag == end_tag.
+
+struct io61_slot
+{
+    unsigned char *buf;
+    off_t tag;
+    off_t end_tag;
+    bool referenced; // CLOCK bit: used since the hand last passed
+    unsigned checked; // write-only: f->gen when last checked for overlap
+};
+
 // io61_file
 //    Data structure for io61 file wrappers. Add your own stuff.
+//
+//    A read-only file caches up to `nslots` recently read regions; reads
+//    are served from whichever slot holds `pos_tag`, and a miss refills
+//    the slot the CLOCK hand picks. In a seekable file every slot holds
+//    one `slotsize`-aligned block. A write-only file keeps up to `nslots`
+//    dirty regions, which never overlap; f->cur->end_tag == pos_tag.
 
 struct io61_file
 {
     int fd;
     int mode;
-    static constexpr off_t bufsize = 4096;
-    unsigned char cbuf[bufsize];
-    off_t tag;
-    off_t end_tag;
+    bool seekable;
     off_t pos_tag;
+    off_t size;      // file size at open, or -1
+    size_t slotsize;
+    size_t nslots;
+    io61_slot *slots;
+    io61_slot *cur;  // slot that last held pos_tag
+    size_t hand;     // CLOCK hand
+    unsigned char *mem;
+    io61_slot *recent[IO61_RECENT];
+    unsigned nrecent;
+    unsigned gen;    // write-only: number of dirty regions started
+
+    // read-ahead state
+    off_t last_seek; // target of the previous seek
+    off_t stride;    // distance between the last two seek targets
+    int nstride;     // number of seeks in a row that moved by `stride`
+    size_t window;   // blocks the next patterned miss reads
+    unsigned char *scratch;
 };
 
+// io61_env_size(name, def)
+//    Return the positive number in environment variable `name`, or `def`.
+
+static size_t io61_env_size(const char *name, size_t def)
+{
+    const char *s = getenv(name);
+    if (!s)
+    {
+        return def;
+    }
+    char *end;
+    unsigned long long n = strtoull(s, &end, 0);
+    if (end == s || *end || n == 0 || n > (1ULL << 30))
+    {
+        return def;
+    }
+    return n;
+}
+
 // io61_fdopen(fd, mode)
 //    Return a new io61_file for file descriptor `fd`. `mode` is
 //    either O_RDONLY for a read-only file or O_WRONLY for a
@@ -32,6 +103,48 @@ io61_file *io61_fdopen(int fd, int mode)
     io61_file *f = new io61_file;
     f->fd = fd;
     f->mode = mode;
+    f->pos_tag = lseek(fd, 0, SEEK_CUR);
+    f->seekable = f->pos_tag >= 0;
+    if (!f->seekable)
+    {
+        f->pos_tag = 0;
+    }
+    struct stat st;
+    f->size = fstat(fd, &st) >= 0 && S_ISREG(st.st_mode) ? st.st_size : -1;
+
+    // slots are whole pages; a stream we cannot seek in needs just one to
+    // write through, since it is written in order
+    size_t slotsize = io61_env_size("IO61_SLOT_SIZE", IO61_SLOT_SIZE);
+    f->slotsize = (slotsize + IO61_PAGE_SIZE - 1) & ~(size_t)(IO61_PAGE_SIZE - 1);
+    f->nslots = mode == O_RDONLY || f->seekable ? io61_env_size("IO61_SLOTS", IO61_SLOTS) : 1;
+    f->mem = (unsigned char *)aligned_alloc(IO61_PAGE_SIZE, f->nslots * f->slotsize);
+    f->slots = new io61_slot[f->nslots];
+    if (!f->mem)
+    {
+        fprintf(stderr, "io61: out of memory\n");
+        exit(1);
+    }
+    for (size_t i = 0; i != f->nslots; ++i)
+    {
+        f->slots[i].buf = f->mem + i * f->slotsize;
+        f->slots[i].tag = f->slots[i].end_tag = f->pos_tag;
+        f->slots[i].referenced = false;
+        f->slots[i].checked = -1;
+    }
+    f->cur = &f->slots[0];
+    f->hand = 0;
+    for (unsigned i = 0; i != IO61_RECENT; ++i)
+    {
+        f->recent[i] = f->cur;
+    }
+    f->nrecent = 0;
+    f->gen = 0;
+
+    f->last_seek = f->pos_tag;
+    f->stride = 0;
+    f->nstride = 0;
+    f->window = 1;
+    f->scratch = nullptr;
     return f;
 }
 
@@ -41,35 +154,97 @@ io61_file *io61_fdopen(int fd, int mode)
 int io61_close(io61_file *f)
 {
     io61_flush(f);
+    if (f->seekable)
+    {
+        // pread and pwrite leave the descriptor's offset alone, and another
+        // process may share it (think `(cat61 a; cat61 b) > out`, or
+        // `(cat61; cat61) < in`)
+        lseek(f->fd, f->pos_tag, SEEK_SET);
+    }
     int r = close(f->fd);
+    free(f->mem);
+    delete[] f->slots;
+    delete[] f->scratch;
     delete f;
     return r;
 }
 
+// io61_find(f, off)
+//    Return the slot of `f` holding the byte at `off`, or nullptr.
+
+static io61_slot *io61_find(io61_file *f, off_t off)
+{
+    for (unsigned i = 0; i != IO61_RECENT; ++i)
+    {
+        io61_slot *s = f->recent[i];
+        if (s->tag <= off && off < s->end_tag)
+        {
+            return s;
+        }
+    }
+    for (size_t i = 0; i != f->nslots; ++i)
+    {
+        io61_slot *s = &f->slots[i];
+        if (s->tag <= off && off < s->end_tag)
+        {
+            return s;
+        }
+    }
+    return nullptr;
+}
+
+// io61_victim(f)
+//    Return the first slot the CLOCK hand finds unused since its last pass.
+
+static io61_slot *io61_victim(io61_file *f)
+{
+    while (true)
+    {
+        io61_slot *s = &f->slots[f->hand];
+        f->hand = (f->hand + 1) % f->nslots;
+        if (!s->referenced)
+        {
+            return s;
+        }
+        s->referenced = false;
+    }
+}
+
+// io61_use(f, s)
+//    Make `s` the current slot of `f`.
+
+static void io61_use(io61_file *f, io61_slot *s)
+{
+    s->referenced = true;
+    f->cur = s;
+    for (unsigned i = 0; i != IO61_RECENT; ++i)
+    {
+        if (f->recent[i] == s)
+        {
+            return;
+        }
+    }
+    f->recent[f->nrecent++ % IO61_RECENT] = s;
+}
+
 // io61_readc(f)
 //    Read a single (unsigned) character from `f` and return it. Returns EOF
 //    (which is -1) on error or end-of-file.
 
 int io61_readc(io61_file *f)
 {
-    unsigned char buf[1];
-    size_t pos = 0;
-    size_t ch = 0;
-    if (f->pos_tag == f->end_tag)
+    io61_slot *s = f->cur;
+    if (f->pos_tag < s->tag || f->pos_tag >= s->end_tag)
     {
-        io61_fill(f);
-        if (f->pos_tag == f->end_tag)
+        if (io61_fill(f) <= 0)
         {
             return -1;
         }
+        s = f->cur;
     }
-    ch = 1;
-    buf[0] = f->cbuf[f->pos_tag - f->tag];
-    f->pos_tag += ch;
-    pos += ch;
-
-    return buf[0];
+    return s->buf[f->pos_tag++ - s->tag];
 }
+
 // io61_read(f, buf, sz)
 //    Read up to `sz` characters from `f` into `buf`. Returns the number of
 //    characters read on success; normally this is `sz`. Returns a short
@@ -79,60 +254,339 @@ int io61_readc(io61_file *f)
 
 ssize_t io61_read(io61_file *f, char *buf, size_t sz)
 {
-    assert(f->tag <= f->pos_tag && f->pos_tag <= f->end_tag);
-    assert(f->end_tag - f->pos_tag <= f->bufsize);
     size_t nread = 0;
-    size_t ch = 0;
     while (nread != sz)
     {
-        if (f->pos_tag == f->end_tag)
+        io61_slot *s = f->cur;
+        if (f->pos_tag < s->tag || f->pos_tag >= s->end_tag)
         {
-            io61_fill(f);
-
-            if (f->pos_tag == f->end_tag)
+            ssize_t n = io61_fill(f);
+            if (n < 0 && nread == 0)
+            {
+                return -1;
+            }
+            else if (n <= 0)
             {
                 break;
             }
+            s = f->cur;
         }
-        if ((sz - nread) < f->end_tag - f->pos_tag)
+        size_t ch = s->end_tag - f->pos_tag;
+        if (ch > sz - nread)
         {
             ch = sz - nread;
-            memcpy(buf, &f->cbuf[f->pos_tag - f->tag], ch);
-            f->pos_tag += ch;
-            nread += ch;
-            buf += ch;
         }
-        else
+        memcpy(buf + nread, &s->buf[f->pos_tag - s->tag], ch);
+        f->pos_tag += ch;
+        nread += ch;
+    }
+    return nread;
+}
+
+// io61_readahead_step(f, block)
+//    Return the distance from `block`, which just missed, to the blocks
+//    the next reads of `f` will likely want: slotsize or -slotsize for a
+//    forward or backward scan, the seek stride for larger strided jumps,
+//    or 0 if there is no pattern. A scan shows as a resident neighbour
+//    block; a stride as three seeks in a row that moved the same distance.
+
+static off_t io61_readahead_step(io61_file *f, off_t block)
+{
+    off_t sz = f->slotsize;
+    if (block >= sz && io61_find(f, block - sz))
+    {
+        return sz;
+    }
+    else if (io61_find(f, block + sz))
+    {
+        return -sz;
+    }
+    else if (f->nstride < 2 || f->stride == 0)
+    {
+        return 0;
+    }
+    else if (f->stride > -sz && f->stride < sz)
+    {
+        return f->stride > 0 ? sz : -sz;
+    }
+    return f->stride;
+}
+
+// io61_fill(f)
+//    Make f->cur a cache slot holding the byte at f->pos_tag, reading from
+//    the file if no slot has it. Returns the number of bytes cached from
+//    f->pos_tag on, which is 0 at end of file, or -1 on error.
+//
+//    A miss that continues a pattern also reads the blocks the pattern
+//    will want next, all with one preadv: the window ends at the missed
+//    block for a backward scan and starts there otherwise, and doubles
+//    with every patterned miss in a row.
+
+ssize_t io61_fill(io61_file *f)
+{
+    assert(f->mode == O_RDONLY);
+    if (io61_slot *s = io61_find(f, f->pos_tag))
+    {
+        io61_use(f, s);
+        return s->end_tag - f->pos_tag;
+    }
+
+    // pipes and terminals have no offsets; they are only read forward
+    if (!f->seekable)
+    {
+        io61_slot *s = io61_victim(f);
+        ssize_t n = read(f->fd, s->buf, f->slotsize);
+        s->tag = f->pos_tag;
+        s->end_tag = f->pos_tag + (n > 0 ? n : 0);
+        io61_use(f, s);
+        return n;
+    }
+
+    // pick the blocks: the one holding pos_tag, then the pattern's next
+    off_t sz = f->slotsize;
+    off_t block = f->pos_tag - f->pos_tag % sz;
+    off_t step = io61_readahead_step(f, block);
+    size_t maxwindow = f->nslots / 8 < IO61_READAHEAD_MAX ? f->nslots / 8 : IO61_READAHEAD_MAX;
+    if (!step || f->window >= maxwindow)
+    {
+        f->window = step && maxwindow ? maxwindow : 1;
+    }
+    else
+    {
+        f->window *= 2;
+    }
+    // strided reads keep their offset within a block
+    off_t base = step == sz || step == -sz ? block : f->pos_tag;
+    off_t blocks[IO61_READAHEAD_MAX];
+    size_t nblocks = 1;
+    blocks[0] = block;
+    while (nblocks < f->window)
+    {
+        off_t next = base + (off_t)nblocks * step;
+        if (next < 0 || (f->size >= 0 && next >= f->size))
         {
-            ch = f->end_tag - f->pos_tag;
-            memcpy(buf, &f->cbuf[f->pos_tag - f->tag], ch);
-            f->pos_tag += ch;
-            nread += ch;
-            buf += ch;
+            break;
+        }
+        next -= next % sz;
+        if (next - block >= IO61_READAHEAD_SPAN || block - next >= IO61_READAHEAD_SPAN
+            || io61_find(f, next))
+        {
+            break;
+        }
+        blocks[nblocks++] = next;
+    }
+    if (step < 0)
+    {
+        for (size_t i = 0; i < nblocks / 2; ++i)
+        {
+            off_t t = blocks[i];
+            blocks[i] = blocks[nblocks - 1 - i];
+            blocks[nblocks - 1 - i] = t;
         }
     }
-    return nread;
 
-    // Note: This function never returns -1 because `io61_readc`
-    // does not distinguish between error and end-of-file.
-    // Your final version should return -1 if a system call indicates
-    // an error.
+    // one iovec per block, and the gaps between blocks to the scratch sink
+    struct iovec iov[IO61_MAX_IOV];
+    io61_slot *owner[IO61_MAX_IOV];
+    int niov = 0;
+    io61_slot *want = nullptr;
+    for (size_t i = 0; i != nblocks; ++i)
+    {
+        off_t gap = i ? blocks[i] - blocks[i - 1] - sz : 0;
+        if (gap && !f->scratch)
+        {
+            f->scratch = new unsigned char[IO61_SCRATCH_SIZE];
+        }
+        while (gap > 0)
+        {
+            size_t ch = gap < IO61_SCRATCH_SIZE ? gap : IO61_SCRATCH_SIZE;
+            iov[niov].iov_base = f->scratch;
+            iov[niov].iov_len = ch;
+            owner[niov++] = nullptr;
+            gap -= ch;
+        }
+        io61_slot *s = io61_victim(f);
+        s->tag = s->end_tag = blocks[i];
+        s->referenced = true;
+        iov[niov].iov_base = s->buf;
+        iov[niov].iov_len = sz;
+        owner[niov++] = s;
+        if (blocks[i] == block)
+        {
+            want = s;
+        }
+    }
+
+    ssize_t n = preadv(f->fd, iov, niov, blocks[0]);
+    if (n < 0)
+    {
+        return -1;
+    }
+    for (int i = 0; i != niov && n > 0; ++i)
+    {
+        size_t ch = (size_t)n < iov[i].iov_len ? n : iov[i].iov_len;
+        if (owner[i])
+        {
+            owner[i]->end_tag = owner[i]->tag + ch;
+        }
+        n -= ch;
+    }
+    io61_use(f, want);
+    return f->pos_tag < want->end_tag ? want->end_tag - f->pos_tag : 0;
 }
 
-void io61_fill(io61_file *f)
+// io61_writeback(f, s)
+//    Write dirty slot `s` of `f` to the file, along with the dirty slots
+//    that continue it in either direction, in one system call. The
+//    slots stay cached, empty, at their end offsets.
+
+static int io61_writeback(io61_file *f, io61_slot *s)
 {
-    assert(f->tag <= f->pos_tag && f->pos_tag <= f->end_tag);
-    assert(f->end_tag - f->pos_tag <= f->bufsize);
-    f->tag = f->pos_tag = f->end_tag;
+    io61_slot *chain[IO61_MAX_IOV];
+    size_t first = IO61_MAX_IOV / 2, last = first + 1;
+    chain[first] = s;
+    for (bool grew = true; grew && f->seekable; )
+    {
+        grew = false;
+        for (size_t i = 0; i != f->nslots; ++i)
+        {
+            io61_slot *t = &f->slots[i];
+            if (t->tag == t->end_tag)
+            {
+                continue;
+            }
+            else if (first > 0 && t->end_tag == chain[first]->tag)
+            {
+                chain[--first] = t;
+                grew = true;
+            }
+            else if (last < IO61_MAX_IOV && t->tag == chain[last - 1]->end_tag)
+            {
+                chain[last++] = t;
+                grew = true;
+            }
+        }
+    }
+
+    struct iovec iov[IO61_MAX_IOV];
+    int niov = 0;
+    for (size_t i = first; i != last; ++i)
+    {
+        iov[niov].iov_base = chain[i]->buf;
+        iov[niov++].iov_len = chain[i]->end_tag - chain[i]->tag;
+    }
+    off_t off = chain[first]->tag;
+    struct iovec *v = iov;
+    while (niov != 0)
+    {
+        ssize_t n;
+        if (f->seekable)
+        {
+            n = pwritev(f->fd, v, niov, off);
+        }
+        else
+        {
+            n = writev(f->fd, v, niov);
+        }
+        if (n == 0)
+        {
+            // nothing written and no error: don't spin on it
+            errno = EIO;
+            return -1;
+        }
+        else if (n < 0 && errno == EAGAIN)
+        {
+            // a nonblocking descriptor is full; sleep until it drains
+            struct pollfd pfd = {f->fd, POLLOUT, 0};
+            if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+            {
+                return -1;
+            }
+            continue;
+        }
+        else if (n < 0 && errno != EINTR)
+        {
+            return -1;
+        }
+        off += n > 0 ? n : 0;
+        while (n > 0 && niov != 0)
+        {
+            size_t ch = (size_t)n < v->iov_len ? n : v->iov_len;
+            v->iov_base = (char *)v->iov_base + ch;
+            v->iov_len -= ch;
+            n -= ch;
+            if (v->iov_len == 0)
+            {
+                ++v;
+                --niov;
+            }
+        }
+    }
+
+    for (size_t i = first; i != last; ++i)
+    {
+        chain[i]->tag = chain[i]->end_tag;
+    }
+    return 0;
+}
 
-    ssize_t n = read(f->fd, f->cbuf, f->bufsize);
-    if (n >= 0)
+// io61_wslot(f)
+//    Make f->cur a slot of write-only file `f` that ends at f->pos_tag and
+//    has room for more, writing back dirty slots as needed.
+
+static int io61_wslot(io61_file *f)
+{
+    off_t sz = f->slotsize;
+    io61_slot *s = nullptr;
+    for (unsigned i = 0; i != IO61_RECENT && !s; ++i)
     {
-        f->end_tag = f->tag + n;
+        io61_slot *t = f->recent[i];
+        if (t->end_tag == f->pos_tag && t->end_tag - t->tag < sz)
+        {
+            s = t;
+        }
+    }
+    for (size_t i = 0; i != f->nslots && !s; ++i)
+    {
+        io61_slot *t = &f->slots[i];
+        if (t->end_tag == f->pos_tag && t->end_tag - t->tag < sz)
+        {
+            s = t;
+        }
+    }
+    if (!s)
+    {
+        s = io61_victim(f);
+        if (s->tag != s->end_tag && io61_writeback(f, s) < 0)
+        {
+            return -1;
+        }
+        s->tag = s->end_tag = f->pos_tag;
     }
 
-    assert(f->tag <= f->pos_tag && f->pos_tag <= f->end_tag);
-    assert(f->end_tag - f->pos_tag <= f->bufsize);
+    // bytes written from now on land in [pos_tag, s->tag + slotsize) and
+    // are newer than whatever other slots hold there. Only a dirty region
+    // started since `s` was last checked can have grown into that range.
+    if (s->tag == s->end_tag)
+    {
+        ++f->gen;
+    }
+    if (s->checked != f->gen)
+    {
+        off_t limit = s->tag + sz;
+        for (size_t i = 0; i != f->nslots; ++i)
+        {
+            io61_slot *t = &f->slots[i];
+            if (t != s && t->tag != t->end_tag && t->tag < limit && f->pos_tag < t->end_tag
+                && io61_writeback(f, t) < 0)
+            {
+                return -1;
+            }
+        }
+        s->checked = f->gen;
+    }
+    io61_use(f, s);
+    return 0;
 }
 
 // io61_writec(f)
@@ -141,15 +595,18 @@ void io61_fill(io61_file *f)
 
 int io61_writec(io61_file *f, int ch)
 {
-    if (f->end_tag == f->tag + f->bufsize)
+    io61_slot *s = f->cur;
+    if (s->end_tag - s->tag == (off_t)f->slotsize)
     {
-        io61_flush(f);
+        if (io61_wslot(f) < 0)
+        {
+            return -1;
+        }
+        s = f->cur;
     }
-    size_t count = 1;
-
-    f->cbuf[f->pos_tag - f->tag] = ch;
-    f->pos_tag += count;
-    f->end_tag += count;
+    s->buf[s->end_tag - s->tag] = ch;
+    ++s->end_tag;
+    ++f->pos_tag;
     return 0;
 }
 
@@ -160,37 +617,28 @@ int io61_writec(io61_file *f, int ch)
 
 ssize_t io61_write(io61_file *f, const char *buf, size_t sz)
 {
-    // Check invariants.
-    assert(f->tag <= f->pos_tag && f->pos_tag <= f->end_tag);
-    assert(f->end_tag - f->pos_tag <= f->bufsize);
-
-    // Write cache invariant.
-    assert(f->pos_tag == f->end_tag);
-
-    /* ANSWER */
+    assert(f->pos_tag == f->cur->end_tag);
     size_t pos = 0;
-    size_t ch = 0;
-
     while (pos < sz)
     {
-        if (f->end_tag == f->tag + f->bufsize)
+        io61_slot *s = f->cur;
+        if (s->end_tag - s->tag == (off_t)f->slotsize)
         {
-            io61_flush(f);
+            if (io61_wslot(f) < 0)
+            {
+                return pos ? (ssize_t)pos : -1;
+            }
+            s = f->cur;
         }
-        if ((off_t)(sz - pos) < f->bufsize - f->pos_tag + f->tag)
+        size_t ch = s->tag + f->slotsize - s->end_tag;
+        if (ch > sz - pos)
         {
             ch = sz - pos;
         }
-        else
-        {
-            ch = f->bufsize - f->pos_tag + f->tag;
-        }
-
-        memcpy(&f->cbuf[f->pos_tag - f->tag], buf, ch);
+        memcpy(&s->buf[s->end_tag - s->tag], buf + pos, ch);
+        s->end_tag += ch;
         f->pos_tag += ch;
-        f->end_tag += ch;
         pos += ch;
-        buf += ch;
     }
     return pos;
 }
@@ -202,34 +650,53 @@ ssize_t io61_write(io61_file *f, const char *buf, size_t sz)
 
 int io61_flush(io61_file *f)
 {
-    assert(f->tag <= f->pos_tag && f->pos_tag <= f->end_tag);
-    assert(f->end_tag - f->pos_tag <= f->bufsize);
-
-    assert(f->pos_tag == f->end_tag);
     if (f->mode == O_RDONLY)
     {
         return 0;
     }
-    ssize_t n = write(f->fd, f->cbuf, f->pos_tag - f->tag);
-    
-    f->tag = f->pos_tag;
+    for (size_t i = 0; i != f->nslots; ++i)
+    {
+        io61_slot *s = &f->slots[i];
+        if (s->tag != s->end_tag && io61_writeback(f, s) < 0)
+        {
+            return -1;
+        }
+    }
     return 0;
 }
+
 // io61_seek(f, pos)
 //    Change the file pointer for file `f` to `pos` bytes into the file.
 //    Returns 0 on success and -1 on failure.
+//
+//    Seeking makes no system call: reads and writes name their offsets
+//    with pread and pwrite, so only pos_tag moves. A read-only file keeps
+//    its cache and the next read misses only if no slot holds `pos`; it
+//    also remembers the distance between seeks for read-ahead. A
+//    write-only file keeps its dirty slots and continues whichever one
+//    ends at `pos`.
 
 int io61_seek(io61_file *f, off_t pos)
 {
-    off_t r = lseek(f->fd, (off_t)pos, SEEK_SET);
-    if (r == (off_t)pos)
+    if (!f->seekable || pos < 0)
     {
-        return 0;
+        errno = f->seekable ? EINVAL : ESPIPE;
+        return -1;
     }
-    else
+    if (f->mode == O_RDONLY)
     {
-        return -1;
+        off_t d = pos - f->last_seek;
+        f->nstride = d == f->stride ? f->nstride + 1 : 0;
+        f->stride = d;
+        f->last_seek = pos;
     }
+    else if (pos != f->pos_tag)
+    {
+        f->pos_tag = pos;
+        return io61_wslot(f);
+    }
+    f->pos_tag = pos;
+    return 0;
 }
 
 // You shouldn't need to change these functions.